@@ -0,0 +1,410 @@
+#include "clipmap.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+//----------------------------------------------------------------------
+// 顶点只携带网格块内的坐标，uOffset 为块在本层网格中的位置，uOrigin 为本层网格左下角的采样坐标。
+// 过渡区内的顶点向粗一层的高度混合：偶数坐标直接取粗一层的采样，奇数坐标取相邻两个（或四个）采样的平均，
+// 外边界上的顶点都落在粗一层的边上，混合系数为 1，与粗一层的三角形完全重合
+//----------------------------------------------------------------------
+static const char *clipmapVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 aGrid;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2DArray uClipmap;
+uniform int uLevel;
+uniform int uLevels;
+uniform ivec2 uOrigin;
+uniform ivec2 uOffset;
+uniform int uTextureSize;
+uniform vec2 uViewer;
+uniform float uTransition;
+
+float fetchHeight(int level, ivec2 p)
+{
+    // 纹理大小为 2 的幂，负坐标取低位同样得到正确的环形位置
+    return texelFetch(uClipmap, ivec3(p & (uTextureSize - 1), level), 0).r;
+}
+
+void main()
+{
+    ivec2 p = uOrigin + uOffset + ivec2(aGrid);
+    float h = fetchHeight(uLevel, p);
+    if (uLevel < uLevels - 1)
+    {
+        // 相机离本层网格中心最多一个采样，外边界到相机的距离不小于 halfSize - 1
+        float halfSize = float(uTextureSize / 2 - 1);
+        vec2 d = abs(vec2(p) - uViewer);
+        vec2 a = clamp((d - (halfSize - uTransition - 1.0)) / uTransition, 0.0, 1.0);
+        float alpha = max(a.x, a.y);
+        ivec2 c = p >> 1;
+        ivec2 odd = p & 1;
+        float coarse = 0.25 * (fetchHeight(uLevel + 1, c) + fetchHeight(uLevel + 1, c + ivec2(odd.x, 0)) +
+                               fetchHeight(uLevel + 1, c + ivec2(0, odd.y)) + fetchHeight(uLevel + 1, c + odd));
+        h = mix(h, coarse, alpha);
+    }
+    vec2 xy = vec2(p) * float(1 << uLevel);
+    gl_Position = projection * view * model * vec4(xy, h, 1.0);
+}
+)";
+
+GeoClipmap::GeoClipmap()
+    : iLevels(0), iBlockSize(0), iGridSize(0), iTextureSize(0), fMinHeight(0.0f), fMaxHeight(0.0f), iUpdatedSamples(0),
+      uiVAO(0), uiVBO(0), uiEBO(0), uiHeightTex(0)
+{
+    iLevelLoc = iLevelsLoc = iOriginLoc = iOffsetLoc = iTextureSizeLoc = iViewerLoc = iTransitionLoc = iClipmapLoc = -1;
+}
+
+GeoClipmap::~GeoClipmap()
+{
+    release();
+}
+
+const char *GeoClipmap::getVertexShaderSource()
+{
+    return clipmapVertexShaderSource;
+}
+
+bool GeoClipmap::init(int iLevels, int iBlockSize, const ClipmapHeightSource &source)
+{
+    release();
+    // 网格块内的坐标用 16 位，中心网格每边 2m + 1 个顶点，m 不超过 64 时每块的顶点数也在 16 位索引范围内
+    if (iLevels < 1 || iBlockSize < 4 || iBlockSize > 64 || (iBlockSize & (iBlockSize - 1)) != 0 || !source)
+    {
+        std::cerr << "Invalid clipmap parameters: " << iLevels << " levels, block size " << iBlockSize << std::endl;
+        return false;
+    }
+    this->iLevels = iLevels;
+    this->iBlockSize = iBlockSize;
+    iGridSize = 4 * iBlockSize - 1;
+    iTextureSize = 4 * iBlockSize;
+    Source = source;
+    LevelOrigins.assign(iLevels, glm::ivec2(0, 0));
+    LevelValid.assign(iLevels, false);
+    fMinHeight = std::numeric_limits<float>::max();
+    fMaxHeight = std::numeric_limits<float>::lowest();
+    iUpdatedSamples = 0;
+
+    buildMeshes();
+
+    glGenTextures(1, &uiHeightTex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, uiHeightTex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, iTextureSize, iTextureSize, iLevels, 0, GL_RED, GL_FLOAT, nullptr);
+    // 着色器只用 texelFetch 读取
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return true;
+}
+
+void GeoClipmap::release()
+{
+    if (uiHeightTex)
+    {
+        glDeleteTextures(1, &uiHeightTex);
+        uiHeightTex = 0;
+    }
+    if (uiVAO)
+    {
+        glDeleteVertexArrays(1, &uiVAO);
+        uiVAO = 0;
+    }
+    GLuint *buffers[2] = {&uiVBO, &uiEBO};
+    for (int i = 0; i < 2; i++)
+    {
+        if (*buffers[i])
+        {
+            glDeleteBuffers(1, buffers[i]);
+            *buffers[i] = 0;
+        }
+    }
+    LevelOrigins.clear();
+    LevelValid.clear();
+    Source = nullptr;
+}
+
+//----------------------------------------------------------------------
+// 追加一块 iWidth x iHeight 个顶点的规则网格，索引相对网格自己的第一个顶点
+//----------------------------------------------------------------------
+void GeoClipmap::addGridMesh(MeshType eType, int iWidth, int iHeight, std::vector<unsigned short> &vertices, std::vector<unsigned short> &indices)
+{
+    Mesh &mesh = Meshes[eType];
+    mesh.iBaseVertex = (int)(vertices.size() / 2);
+    mesh.iIndexOffset = (int)(indices.size() * sizeof(unsigned short));
+    mesh.iWidth = iWidth;
+    mesh.iHeight = iHeight;
+    for (int j = 0; j < iHeight; j++)
+    {
+        for (int i = 0; i < iWidth; i++)
+        {
+            vertices.push_back((unsigned short)i);
+            vertices.push_back((unsigned short)j);
+        }
+    }
+    for (int j = 0; j < iHeight - 1; j++)
+    {
+        for (int i = 0; i < iWidth - 1; i++)
+        {
+            unsigned short v00 = (unsigned short)(j * iWidth + i);
+            unsigned short v10 = (unsigned short)(v00 + 1);
+            unsigned short v01 = (unsigned short)(v00 + iWidth);
+            unsigned short v11 = (unsigned short)(v01 + 1);
+            indices.push_back(v00);
+            indices.push_back(v10);
+            indices.push_back(v11);
+            indices.push_back(v00);
+            indices.push_back(v11);
+            indices.push_back(v01);
+        }
+    }
+    mesh.iIndexCount = (int)(indices.size() - mesh.iIndexOffset / sizeof(unsigned short));
+}
+
+//----------------------------------------------------------------------
+// 沿本层网格外边界每两个格子一个退化三角形：两端是粗一层的顶点，中间是本层多出的顶点。
+// 过渡后三点共线，三角形面积为 0，只用来让光栅化在 T 形接缝处不留下缝隙
+//----------------------------------------------------------------------
+void GeoClipmap::addSeamMesh(std::vector<unsigned short> &vertices, std::vector<unsigned short> &indices)
+{
+    Mesh &mesh = Meshes[MESH_SEAM];
+    mesh.iBaseVertex = (int)(vertices.size() / 2);
+    mesh.iIndexOffset = (int)(indices.size() * sizeof(unsigned short));
+    mesh.iWidth = iGridSize;
+    mesh.iHeight = iGridSize;
+    int last = iGridSize - 1;
+    // 下、上、左、右四条边，每条边 iGridSize 个顶点
+    for (int edge = 0; edge < 4; edge++)
+    {
+        int iFirst = (int)(vertices.size() / 2) - mesh.iBaseVertex;
+        for (int k = 0; k < iGridSize; k++)
+        {
+            int x = edge < 2 ? k : (edge == 2 ? 0 : last);
+            int y = edge < 2 ? (edge == 0 ? 0 : last) : k;
+            vertices.push_back((unsigned short)x);
+            vertices.push_back((unsigned short)y);
+        }
+        for (int k = 0; k + 2 < iGridSize; k += 2)
+        {
+            indices.push_back((unsigned short)(iFirst + k));
+            indices.push_back((unsigned short)(iFirst + k + 1));
+            indices.push_back((unsigned short)(iFirst + k + 2));
+        }
+    }
+    mesh.iIndexCount = (int)(indices.size() - mesh.iIndexOffset / sizeof(unsigned short));
+}
+
+//----------------------------------------------------------------------
+// 所有共享网格放在同一个 VBO 和索引缓冲区中，绘制时用 basevertex 选择
+//----------------------------------------------------------------------
+void GeoClipmap::buildMeshes()
+{
+    int m = iBlockSize;
+    std::vector<unsigned short> vertices;
+    std::vector<unsigned short> indices;
+    addGridMesh(MESH_BLOCK, m, m, vertices, indices);
+    addGridMesh(MESH_FIXUP_H, m, 3, vertices, indices);
+    addGridMesh(MESH_FIXUP_V, 3, m, vertices, indices);
+    addGridMesh(MESH_TRIM_V, 2, 2 * m + 1, vertices, indices);
+    addGridMesh(MESH_TRIM_H, 2 * m, 2, vertices, indices);
+    addGridMesh(MESH_CENTER, 2 * m + 1, 2 * m + 1, vertices, indices);
+    addSeamMesh(vertices, indices);
+
+    glGenVertexArrays(1, &uiVAO);
+    glGenBuffers(1, &uiVBO);
+    glGenBuffers(1, &uiEBO);
+    glBindVertexArray(uiVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, uiVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned short) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 2 * sizeof(unsigned short), (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeoClipmap::setShader(unsigned int shaderProgram)
+{
+    iLevelLoc = glGetUniformLocation(shaderProgram, "uLevel");
+    iLevelsLoc = glGetUniformLocation(shaderProgram, "uLevels");
+    iOriginLoc = glGetUniformLocation(shaderProgram, "uOrigin");
+    iOffsetLoc = glGetUniformLocation(shaderProgram, "uOffset");
+    iTextureSizeLoc = glGetUniformLocation(shaderProgram, "uTextureSize");
+    iViewerLoc = glGetUniformLocation(shaderProgram, "uViewer");
+    iTransitionLoc = glGetUniformLocation(shaderProgram, "uTransition");
+    iClipmapLoc = glGetUniformLocation(shaderProgram, "uClipmap");
+}
+
+void GeoClipmap::uploadRegion(int iLevel, int x0, int y0, int iWidth, int iHeight)
+{
+    if (iWidth <= 0 || iHeight <= 0)
+    {
+        return;
+    }
+    Staging.resize((size_t)iWidth * iHeight);
+    Source(iLevel, x0, y0, iWidth, iHeight, Staging.data());
+    for (size_t i = 0; i < Staging.size(); i++)
+    {
+        fMinHeight = std::min(fMinHeight, Staging[i]);
+        fMaxHeight = std::max(fMaxHeight, Staging[i]);
+    }
+    iUpdatedSamples += iWidth * iHeight;
+
+    // 矩形在纹理中的起点，宽高不超过纹理大小，跨过纹理边界的部分绕回到另一侧
+    int iMask = iTextureSize - 1;
+    int tx = x0 & iMask;
+    int ty = y0 & iMask;
+    int w0 = std::min(iWidth, iTextureSize - tx);
+    int h0 = std::min(iHeight, iTextureSize - ty);
+    const int spansX[2][2] = {{0, w0}, {w0, iWidth - w0}};
+    const int spansY[2][2] = {{0, h0}, {h0, iHeight - h0}};
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, iWidth);
+    for (int sy = 0; sy < 2; sy++)
+    {
+        for (int sx = 0; sx < 2; sx++)
+        {
+            if (spansX[sx][1] <= 0 || spansY[sy][1] <= 0)
+            {
+                continue;
+            }
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, spansX[sx][0]);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, spansY[sy][0]);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, (tx + spansX[sx][0]) & iMask, (ty + spansY[sy][0]) & iMask, iLevel,
+                            spansX[sx][1], spansY[sy][1], 1, GL_RED, GL_FLOAT, Staging.data());
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+void GeoClipmap::updateLevel(int iLevel, const glm::ivec2 &origin)
+{
+    glm::ivec2 previous = LevelOrigins[iLevel];
+    int dx = origin.x - previous.x;
+    int dy = origin.y - previous.y;
+    if (LevelValid[iLevel] && dx == 0 && dy == 0)
+    {
+        return;
+    }
+    LevelOrigins[iLevel] = origin;
+    if (!LevelValid[iLevel] || std::abs(dx) >= iTextureSize || std::abs(dy) >= iTextureSize)
+    {
+        // 第一次或者移动超过一整层，全部重写
+        LevelValid[iLevel] = true;
+        uploadRegion(iLevel, origin.x, origin.y, iTextureSize, iTextureSize);
+        return;
+    }
+    // 新露出的列与行，其余采样在纹理中的位置不变；两者相交的角落写两次
+    if (dx > 0)
+    {
+        uploadRegion(iLevel, previous.x + iTextureSize, origin.y, dx, iTextureSize);
+    }
+    else if (dx < 0)
+    {
+        uploadRegion(iLevel, origin.x, origin.y, -dx, iTextureSize);
+    }
+    if (dy > 0)
+    {
+        uploadRegion(iLevel, origin.x, previous.y + iTextureSize, iTextureSize, dy);
+    }
+    else if (dy < 0)
+    {
+        uploadRegion(iLevel, origin.x, origin.y, iTextureSize, -dy);
+    }
+}
+
+void GeoClipmap::drawMesh(MeshType eType, int iLevel, int ox, int oy, const Frustum &frustum)
+{
+    const Mesh &mesh = Meshes[eType];
+    float fSpacing = (float)(1 << iLevel);
+    glm::vec3 vMin((LevelOrigins[iLevel].x + ox) * fSpacing, (LevelOrigins[iLevel].y + oy) * fSpacing, fMinHeight);
+    glm::vec3 vMax(vMin.x + (mesh.iWidth - 1) * fSpacing, vMin.y + (mesh.iHeight - 1) * fSpacing, fMaxHeight);
+    if (frustum.testAABB(vMin, vMax) == FRUSTUM_OUTSIDE)
+    {
+        return;
+    }
+    glUniform2i(iOffsetLoc, ox, oy);
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.iIndexCount, GL_UNSIGNED_SHORT, (void *)(size_t)mesh.iIndexOffset, mesh.iBaseVertex);
+}
+
+void GeoClipmap::render(const glm::vec3 &eye_position, const glm::mat4 &viewProjection)
+{
+    if (!isReady())
+    {
+        return;
+    }
+    int m = iBlockSize;
+
+    // 每层左下角取偶数（与粗一层的顶点对齐），使细一层恰好落在本层中间 2m 个格子的空洞内，
+    // 相机离本层网格中心不超过一个采样；只有相机跨过 2^(l+1) 的边界时第 l 层才会移动
+    iUpdatedSamples = 0;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, uiHeightTex);
+    for (int l = 0; l < iLevels; l++)
+    {
+        float fCell = (float)(2 << l);
+        glm::ivec2 origin((int)std::floor(eye_position.x / fCell) * 2 - (2 * m - 2), (int)std::floor(eye_position.y / fCell) * 2 - (2 * m - 2));
+        updateLevel(l, origin);
+    }
+
+    Frustum frustum;
+    frustum.extract(viewProjection);
+
+    glUniform1i(iClipmapLoc, 0);
+    glUniform1i(iLevelsLoc, iLevels);
+    glUniform1i(iTextureSizeLoc, iTextureSize);
+    glUniform1f(iTransitionLoc, iGridSize / 10.0f);
+    glBindVertexArray(uiVAO);
+
+    // 12 个块在本层网格中的起点，中间两个格子宽的空隙由补缝条填充
+    const int blockOffsets[4] = {0, m - 1, 2 * m, 3 * m - 1};
+    for (int l = 0; l < iLevels; l++)
+    {
+        float fSpacing = (float)(1 << l);
+        glUniform1i(iLevelLoc, l);
+        glUniform2i(iOriginLoc, LevelOrigins[l].x, LevelOrigins[l].y);
+        glUniform2f(iViewerLoc, eye_position.x / fSpacing, eye_position.y / fSpacing);
+
+        for (int by = 0; by < 4; by++)
+        {
+            for (int bx = 0; bx < 4; bx++)
+            {
+                if ((bx == 1 || bx == 2) && (by == 1 || by == 2))
+                {
+                    continue;
+                }
+                drawMesh(MESH_BLOCK, l, blockOffsets[bx], blockOffsets[by], frustum);
+            }
+        }
+        drawMesh(MESH_FIXUP_H, l, 0, 2 * m - 2, frustum);
+        drawMesh(MESH_FIXUP_H, l, 3 * m - 1, 2 * m - 2, frustum);
+        drawMesh(MESH_FIXUP_V, l, 2 * m - 2, 0, frustum);
+        drawMesh(MESH_FIXUP_V, l, 2 * m - 2, 3 * m - 1, frustum);
+
+        if (l == 0)
+        {
+            drawMesh(MESH_CENTER, l, m - 1, m - 1, frustum);
+        }
+        else
+        {
+            // 细一层在空洞中靠左（下）时边条在右（上），反之在左（下）；竖直部分占满 2m 个格子，水平部分让开竖直部分
+            int tx = LevelOrigins[l - 1].x / 2 - (LevelOrigins[l].x + m - 1);
+            int ty = LevelOrigins[l - 1].y / 2 - (LevelOrigins[l].y + m - 1);
+            drawMesh(MESH_TRIM_V, l, tx == 0 ? 3 * m - 2 : m - 1, m - 1, frustum);
+            drawMesh(MESH_TRIM_H, l, tx == 0 ? m - 1 : m, ty == 0 ? 3 * m - 2 : m - 1, frustum);
+        }
+        if (l < iLevels - 1)
+        {
+            drawMesh(MESH_SEAM, l, 0, 0, frustum);
+        }
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <glad/glad.h>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frustum.h"
+
+//----------------------------------------------------------------------
+// 高度来源：按行主序写入等级 iLevel 上 [x0, x0 + iWidth) x [y0, y0 + iHeight) 的世界高度
+// 等级 iLevel 的采样 (x, y) 位于最细网格的 (x << iLevel, y << iLevel)，坐标可以为负或超出地图
+//----------------------------------------------------------------------
+typedef std::function<void(int iLevel, int x0, int y0, int iWidth, int iHeight, float *dst)> ClipmapHeightSource;
+
+//----------------------------------------------------------------------
+// 几何裁剪图（geometry clipmap）地形
+// 以相机为中心嵌套 iLevels 层网格，第 l 层的顶点间距为 2^l，每层 n = 4m - 1 个顶点见方。
+// 每层由少量共享网格拼成：12 个 m x m 的块、4 个补缝条、与内层之间的 L 形边条、外边界的退化三角形，最细层中间再加一块中心网格。
+// 每层的高度放在纹理数组的一层中，按采样坐标对纹理大小取模环形寻址；相机移动时只写入新露出的行和列，
+// 每帧的开销只与层数和 m 有关，与地图大小无关。
+// 每层外边界附近的顶点向粗一层的高度过渡，外边界上与粗一层完全一致，层与层之间没有裂缝和跳变
+//----------------------------------------------------------------------
+class GeoClipmap
+{
+public:
+    GeoClipmap();
+    ~GeoClipmap();
+
+    //----------------------------------------------------------------------
+    // 创建网格与高度纹理
+    // iLevels: 层数，最粗一层的范围为 (4m - 2) * 2^(iLevels - 1)
+    // iBlockSize: m，2 的幂，不超过 64
+    // source: 高度来源，在 render 中按需调用
+    //----------------------------------------------------------------------
+    bool init(int iLevels, int iBlockSize, const ClipmapHeightSource &source);
+    void release();
+
+    bool isReady() const { return uiHeightTex != 0; }
+
+    // 地形着色器使用的顶点着色器，与 LandScapeMap 共用片段着色器
+    static const char *getVertexShaderSource();
+
+    // 记录地形着色器的 uniform 位置
+    void setShader(unsigned int shaderProgram);
+
+    //----------------------------------------------------------------------
+    // 把各层移动到相机附近，写入新露出的高度，然后绘制，要求地形着色器已经通过 glUseProgram 启用
+    // eye_position: 相机位置
+    // viewProjection: projection * view，用于视锥体裁剪网格块
+    //----------------------------------------------------------------------
+    void render(const glm::vec3 &eye_position, const glm::mat4 &viewProjection);
+
+    // 上一帧写入纹理的采样数，只用于调试
+    int getUpdatedSamples() const { return iUpdatedSamples; }
+
+private:
+    GeoClipmap(const GeoClipmap &);
+    GeoClipmap &operator=(const GeoClipmap &);
+
+    // 共享网格的种类
+    enum MeshType
+    {
+        MESH_BLOCK,   // m x m
+        MESH_FIXUP_H, // m x 3，左右两侧中间的补缝条
+        MESH_FIXUP_V, // 3 x m，上下两侧中间的补缝条
+        MESH_TRIM_V,  // 2 x (2m + 1)，L 形边条的竖直部分
+        MESH_TRIM_H,  // 2m x 2，L 形边条的水平部分
+        MESH_CENTER,  // (2m + 1) x (2m + 1)，最细层中间的网格
+        MESH_SEAM,    // 外边界上的退化三角形，填补与粗一层之间的 T 形接缝
+        MESH_COUNT
+    };
+
+    struct Mesh
+    {
+        int iBaseVertex;
+        int iIndexOffset; // 在索引缓冲区中的字节偏移
+        int iIndexCount;
+        int iWidth;       // 覆盖的顶点范围，用于视锥体裁剪
+        int iHeight;
+    };
+
+    void buildMeshes();
+    void addGridMesh(MeshType eType, int iWidth, int iHeight, std::vector<unsigned short> &vertices, std::vector<unsigned short> &indices);
+    void addSeamMesh(std::vector<unsigned short> &vertices, std::vector<unsigned short> &indices);
+
+    // 移动第 iLevel 层到新的左下角，只写入新露出的行和列
+    void updateLevel(int iLevel, const glm::ivec2 &origin);
+    // 把采样矩形 [x0, x0 + iWidth) x [y0, y0 + iHeight) 写入纹理，跨过纹理边界时拆成最多 4 块
+    void uploadRegion(int iLevel, int x0, int y0, int iWidth, int iHeight);
+
+    void drawMesh(MeshType eType, int iLevel, int ox, int oy, const Frustum &frustum);
+
+    int iLevels;
+    int iBlockSize;    // m
+    int iGridSize;     // n = 4m - 1
+    int iTextureSize;  // 4m，每层纹理的大小，2 的幂，环形寻址只需要取低位
+    ClipmapHeightSource Source;
+
+    std::vector<glm::ivec2> LevelOrigins; // 每层网格左下角的采样坐标
+    std::vector<bool> LevelValid;         // 每层纹理内容是否与 LevelOrigins 一致
+    std::vector<float> Staging;           // 上传用的暂存区
+    float fMinHeight;                     // 已经写入的高度范围，用于视锥体裁剪
+    float fMaxHeight;
+    int iUpdatedSamples;
+
+    Mesh Meshes[MESH_COUNT];
+    GLuint uiVAO;
+    GLuint uiVBO;
+    GLuint uiEBO;
+    GLuint uiHeightTex; // GL_TEXTURE_2D_ARRAY，R32F，每层一个切片
+
+    // 地形着色器的 uniform 位置
+    int iLevelLoc;
+    int iLevelsLoc;
+    int iOriginLoc;
+    int iOffsetLoc;
+    int iTextureSizeLoc;
+    int iViewerLoc;
+    int iTransitionLoc;
+    int iClipmapLoc;
+};
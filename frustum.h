@@ -0,0 +1,69 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// 包围盒与视锥体的关系
+enum FRUSTUM_RESULT
+{
+    FRUSTUM_OUTSIDE,   // 完全在视锥体外
+    FRUSTUM_INTERSECT, // 与视锥体相交
+    FRUSTUM_INSIDE     // 完全在视锥体内
+};
+
+//----------------------------------------------------------------------
+// 视锥体，由 projection * view 矩阵提取 6 个裁剪平面
+// 平面方程为 dot(n, p) + d >= 0 表示在视锥体内侧
+//----------------------------------------------------------------------
+struct Frustum
+{
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    void extract(const glm::mat4 &viewProjection)
+    {
+        // glm 为列主序，第 i 行为 (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+
+        for (int i = 0; i < 6; i++)
+        {
+            float len = glm::length(glm::vec3(planes[i].x, planes[i].y, planes[i].z));
+            if (len > 0.0f)
+            {
+                planes[i] = planes[i] / len;
+            }
+        }
+    }
+
+    //----------------------------------------------------------------------
+    // 检测轴对齐包围盒与视锥体的关系
+    //----------------------------------------------------------------------
+    FRUSTUM_RESULT testAABB(const glm::vec3 &vMin, const glm::vec3 &vMax) const
+    {
+        FRUSTUM_RESULT result = FRUSTUM_INSIDE;
+        for (int i = 0; i < 6; i++)
+        {
+            const glm::vec4 &p = planes[i];
+            // 沿平面法线方向最远的顶点（p-vertex）和最近的顶点（n-vertex）
+            glm::vec3 vPositive(p.x >= 0 ? vMax.x : vMin.x, p.y >= 0 ? vMax.y : vMin.y, p.z >= 0 ? vMax.z : vMin.z);
+            glm::vec3 vNegative(p.x >= 0 ? vMin.x : vMax.x, p.y >= 0 ? vMin.y : vMax.y, p.z >= 0 ? vMin.z : vMax.z);
+
+            if (p.x * vPositive.x + p.y * vPositive.y + p.z * vPositive.z + p.w < 0)
+            {
+                return FRUSTUM_OUTSIDE;
+            }
+            if (p.x * vNegative.x + p.y * vNegative.y + p.z * vNegative.z + p.w < 0)
+            {
+                result = FRUSTUM_INTERSECT;
+            }
+        }
+        return result;
+    }
+};
@@ -50,6 +50,8 @@ bool CGEOMIPMAPPING::Init(int iPatchSize)
         {
             // initialize the patches to the lowest level of detail
             m_pPatchs[GetPatchNumber(x, z)].m_iLOD = m_iMaxLOD;
+            // patches are visible until the culling pass says otherwise
+            m_pPatchs[GetPatchNumber(x, z)].m_bVisible = true;
         }
     }
     return true;
@@ -103,7 +105,8 @@ void CGEOMIPMAPPING::RenderPatch(int PX, int PZ, bool bMultiTex, bool bDetail)
 
     // find out information about the patch to the current patch's left, if the patch is of a
     // greater detail or there is no patch to the left, we can render the mid-left vertex
-    if (m_pPatchs[GetPatchNumber(PX - 1, PZ)].m_iLOD <= m_pPatchs[iPatch].m_iLOD || PX == 0)
+    // (the edge checks come first so we never read outside the patch array)
+    if (PX == 0 || m_pPatchs[GetPatchNumber(PX - 1, PZ)].m_iLOD <= m_pPatchs[iPatch].m_iLOD)
     {
         patchNeighbor.m_bLeft = true;
     }
@@ -112,7 +115,7 @@ void CGEOMIPMAPPING::RenderPatch(int PX, int PZ, bool bMultiTex, bool bDetail)
         patchNeighbor.m_bLeft = false;
     }
 
-    if (m_pPatchs[GetPatchNumber(PX, PZ + 1)].m_iLOD <= m_pPatchs[iPatch].m_iLOD || PZ == m_iNumPatchesPerSide)
+    if (PZ == m_iNumPatchesPerSide - 1 || m_pPatchs[GetPatchNumber(PX, PZ + 1)].m_iLOD <= m_pPatchs[iPatch].m_iLOD)
     {
         patchNeighbor.m_bUp = true;
     }
@@ -121,7 +124,7 @@ void CGEOMIPMAPPING::RenderPatch(int PX, int PZ, bool bMultiTex, bool bDetail)
         patchNeighbor.m_bUp = false;
     }
 
-    if (m_pPatchs[GetPatchNumber(PX + 1, PZ)].m_iLOD <= m_pPatchs[iPatch].m_iLOD || PX == m_iNumPatchesPerSide)
+    if (PX == m_iNumPatchesPerSide - 1 || m_pPatchs[GetPatchNumber(PX + 1, PZ)].m_iLOD <= m_pPatchs[iPatch].m_iLOD)
     {
         patchNeighbor.m_bRight = true;
     }
@@ -130,7 +133,7 @@ void CGEOMIPMAPPING::RenderPatch(int PX, int PZ, bool bMultiTex, bool bDetail)
         patchNeighbor.m_bRight = false;
     }
 
-    if (m_pPatchs[GetPatchNumber(PX, PZ - 1)].m_iLOD <= m_pPatchs[iPatch].m_iLOD || PZ == 0)
+    if (PZ == 0 || m_pPatchs[GetPatchNumber(PX, PZ - 1)].m_iLOD <= m_pPatchs[iPatch].m_iLOD)
     {
         patchNeighbor.m_bDown = true;
     }
@@ -0,0 +1,37 @@
+#include "glutil.h"
+#include <iostream>
+
+//----------------------------------------------------------------------
+// 编译并链接计算着色器，失败时输出日志并返回 0
+//----------------------------------------------------------------------
+GLuint CompileComputeProgram(const char *source, const char *defines)
+{
+    const char *sources[3] = {"#version 430 core\n", defines, source};
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 3, sources, nullptr);
+    glCompileShader(shader);
+    GLint iStatus = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &iStatus);
+    if (!iStatus)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Error compiling compute shader: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &iStatus);
+    if (!iStatus)
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Error linking compute shader: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <glad/glad.h>
+
+// 编译并链接 GLSL 430 计算着色器，defines 插在版本声明之后；失败时输出日志并返回 0
+GLuint CompileComputeProgram(const char *source, const char *defines = "");
@@ -0,0 +1,421 @@
+#include "gpuculling.h"
+#include "glutil.h"
+#include <iostream>
+#include <string>
+
+// 每个工作组处理的补丁数
+#define GPU_CULL_GROUP 64
+
+//----------------------------------------------------------------------
+// 各遍共用的声明，绑定点与 GpuPatchCuller 中的缓冲区一一对应
+//----------------------------------------------------------------------
+static const char *cullCommonSource = R"(
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) readonly buffer Bounds { vec4 bounds[]; };
+layout(std430, binding = 1) readonly buffer Errors { float errors[]; };
+layout(std430, binding = 2) readonly buffer Variants { uvec2 variants[]; };
+layout(std430, binding = 3) buffer LODsIn { int lodsIn[]; };
+layout(std430, binding = 4) buffer LODsOut { int lodsOut[]; };
+layout(std430, binding = 5) buffer Morphs { float morphs[]; };
+layout(std430, binding = 6) writeonly buffer PatchData { vec4 patchData[]; };
+layout(std430, binding = 7) writeonly buffer Commands { uint commands[]; };
+layout(std430, binding = 8) buffer Counter { uint drawCount; };
+
+uniform int uNumPatches;
+uniform int uPatchesPerSide;
+uniform int uVertsPerPatch;
+uniform int uMaxLOD;
+uniform vec4 uPlanes[6];
+uniform vec3 uEye;
+uniform float uPixelsPerUnit;
+uniform float uPixelError;
+uniform float uMorphRange;
+uniform int uGeomorph;
+
+// 相机到补丁包围盒的最近距离
+float patchDistance(int p)
+{
+    return distance(uEye, clamp(uEye, bounds[p * 2].xyz, bounds[p * 2 + 1].xyz));
+}
+)";
+
+//----------------------------------------------------------------------
+// 视锥体裁剪与等级选择，与 Frustum::testAABB、LandScapeMap::selectLOD 相同
+//----------------------------------------------------------------------
+static const char *selectShaderSource = R"(
+void main()
+{
+    int p = int(gl_GlobalInvocationID.x);
+    if (p >= uNumPatches)
+        return;
+    vec3 vMin = bounds[p * 2].xyz;
+    vec3 vMax = bounds[p * 2 + 1].xyz;
+    for (int i = 0; i < 6; i++)
+    {
+        vec4 plane = uPlanes[i];
+        vec3 v = vec3(plane.x >= 0.0 ? vMax.x : vMin.x, plane.y >= 0.0 ? vMax.y : vMin.y, plane.z >= 0.0 ? vMax.z : vMin.z);
+        precise float f = plane.x * v.x + plane.y * v.y + plane.z * v.z + plane.w;
+        if (f < 0.0)
+        {
+            lodsOut[p] = -1;
+            return;
+        }
+    }
+    float d = patchDistance(p);
+    int lod = 0;
+    if (d > 0.0)
+    {
+        float maxError = uPixelError * d / uPixelsPerUnit;
+        for (int l = uMaxLOD; l > 0; l--)
+        {
+            if (errors[p * (uMaxLOD + 1) + l] <= maxError)
+            {
+                lod = l;
+                break;
+            }
+        }
+    }
+    lodsOut[p] = lod;
+}
+)";
+
+//----------------------------------------------------------------------
+// 相邻可见补丁的等级最多相差 1：每一遍取 min(自己, 相邻可见补丁 + 1)
+// 等级不超过 uMaxLOD，uMaxLOD 遍之后与 CPU 上反复放宽直到不变的结果相同
+//----------------------------------------------------------------------
+static const char *clampShaderSource = R"(
+void main()
+{
+    int p = int(gl_GlobalInvocationID.x);
+    if (p >= uNumPatches)
+        return;
+    int lod = lodsIn[p];
+    if (lod > 0)
+    {
+        int x = p % uPatchesPerSide;
+        int y = p / uPatchesPerSide;
+        int n;
+        if (x > 0 && (n = lodsIn[p - 1]) >= 0)
+            lod = min(lod, n + 1);
+        if (x < uPatchesPerSide - 1 && (n = lodsIn[p + 1]) >= 0)
+            lod = min(lod, n + 1);
+        if (y > 0 && (n = lodsIn[p - uPatchesPerSide]) >= 0)
+            lod = min(lod, n + 1);
+        if (y < uPatchesPerSide - 1 && (n = lodsIn[p + uPatchesPerSide]) >= 0)
+            lod = min(lod, n + 1);
+    }
+    lodsOut[p] = lod;
+}
+)";
+
+//----------------------------------------------------------------------
+// 形变系数，与 LandScapeMap::computeMorph 相同
+//----------------------------------------------------------------------
+static const char *morphShaderSource = R"(
+void main()
+{
+    int p = int(gl_GlobalInvocationID.x);
+    if (p >= uNumPatches)
+        return;
+    int lod = lodsIn[p];
+    float morph = 0.0;
+    if (lod >= 0 && lod < uMaxLOD)
+    {
+        float d = patchDistance(p);
+        float start = errors[p * (uMaxLOD + 1) + lod] * uPixelsPerUnit / uPixelError;
+        float end = errors[p * (uMaxLOD + 1) + lod + 1] * uPixelsPerUnit / uPixelError;
+        float range = (end - start) * uMorphRange;
+        morph = range <= 0.0 ? (d >= end ? 1.0 : 0.0) : clamp((d - (end - range)) / range, 0.0, 1.0);
+    }
+    morphs[p] = morph;
+}
+)";
+
+//----------------------------------------------------------------------
+// 选择接缝版本、写入形变数据（同 LandScapeMap::updatePatchMorph），可见补丁追加一条间接绘制命令
+//----------------------------------------------------------------------
+static const char *emitShaderSource = R"(
+void main()
+{
+    int p = int(gl_GlobalInvocationID.x);
+    if (p >= uNumPatches)
+        return;
+    int lod = lodsIn[p];
+    if (lod < 0)
+        return;
+    int x = p % uPatchesPerSide;
+    int y = p / uPatchesPerSide;
+
+    // 接缝掩码：左 1、上 2、右 4、下 8
+    int mask = 0;
+    mask |= x > 0 && lodsIn[p - 1] > lod ? 1 : 0;
+    mask |= x < uPatchesPerSide - 1 && lodsIn[p + 1] > lod ? 4 : 0;
+    mask |= y > 0 && lodsIn[p - uPatchesPerSide] > lod ? 8 : 0;
+    mask |= y < uPatchesPerSide - 1 && lodsIn[p + uPatchesPerSide] > lod ? 2 : 0;
+
+    if (uGeomorph != 0)
+    {
+        float morph = morphs[p];
+        ivec2 neighbors[4] = ivec2[4](ivec2(x - 1, y), ivec2(x, y + 1), ivec2(x + 1, y), ivec2(x, y - 1));
+        float edge[4];
+        for (int n = 0; n < 4; n++)
+        {
+            edge[n] = morph;
+            if (any(lessThan(neighbors[n], ivec2(0))) || any(greaterThanEqual(neighbors[n], ivec2(uPatchesPerSide))))
+                continue;
+            int q = neighbors[n].y * uPatchesPerSide + neighbors[n].x;
+            int neighborLOD = lodsIn[q];
+            if (neighborLOD == lod)
+                edge[n] = max(morph, morphs[q]);
+            else if (neighborLOD >= 0 && neighborLOD < lod)
+                edge[n] = 0.0;
+        }
+        patchData[p * 2] = vec4(float(lod), morph, 0.0, 0.0);
+        patchData[p * 2 + 1] = vec4(edge[0], edge[1], edge[2], edge[3]);
+    }
+
+    // DrawElementsIndirectCommand: count, instanceCount, firstIndex, baseVertex, baseInstance
+    uvec2 variant = variants[lod * 16 + mask];
+    uint slot = atomicAdd(drawCount, 1u);
+    commands[slot * 5u] = variant.x;
+    commands[slot * 5u + 1u] = 1u;
+    commands[slot * 5u + 2u] = variant.y;
+    commands[slot * 5u + 3u] = uint(p * uVertsPerPatch);
+    commands[slot * 5u + 4u] = 0u;
+}
+)";
+
+static GLuint CompileCullProgram(const char *source)
+{
+    std::string strSource = std::string(cullCommonSource) + source;
+    return CompileComputeProgram(strSource.c_str());
+}
+
+GpuPatchCuller::GpuPatchCuller()
+    : iNumPatches(0), iNumPatchesPerSide(0), iVertsPerPatch(0), iMaxLOD(0), iFinalLODs(0),
+      uiBoundsSSBO(0), uiErrorsSSBO(0), uiVariantsSSBO(0), uiMorphSSBO(0), uiPatchDataSSBO(0), uiCommandSSBO(0), uiCounterSSBO(0),
+      uiSelectProgram(0), uiClampProgram(0), uiMorphProgram(0), uiEmitProgram(0)
+{
+    uiLODSSBO[0] = uiLODSSBO[1] = 0;
+}
+
+GpuPatchCuller::~GpuPatchCuller()
+{
+    release();
+}
+
+bool GpuPatchCuller::isSupported()
+{
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+static GLuint CreateStorageBuffer(size_t size, const void *data, GLenum eUsage)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)size, data, eUsage);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+bool GpuPatchCuller::init(int iNumPatchesPerSide, int iVertsPerPatch, int iMaxLOD, const std::vector<glm::vec4> &bounds, const std::vector<float> &errors, const std::vector<GLuint> &variants)
+{
+    release();
+    if (!isSupported())
+    {
+        std::cerr << "GPU patch culling requires OpenGL 4.3" << std::endl;
+        return false;
+    }
+    iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    if (bounds.size() != (size_t)iNumPatches * 2 || errors.size() != (size_t)iNumPatches * (iMaxLOD + 1) || variants.size() != (size_t)(iMaxLOD + 1) * 16 * 2)
+    {
+        std::cerr << "Invalid patch data for GPU culling" << std::endl;
+        return false;
+    }
+    this->iNumPatchesPerSide = iNumPatchesPerSide;
+    this->iVertsPerPatch = iVertsPerPatch;
+    this->iMaxLOD = iMaxLOD;
+
+    uiSelectProgram = CompileCullProgram(selectShaderSource);
+    uiClampProgram = CompileCullProgram(clampShaderSource);
+    uiMorphProgram = CompileCullProgram(morphShaderSource);
+    uiEmitProgram = CompileCullProgram(emitShaderSource);
+    if (!uiSelectProgram || !uiClampProgram || !uiMorphProgram || !uiEmitProgram)
+    {
+        release();
+        return false;
+    }
+    SelectUniforms = initUniforms(uiSelectProgram);
+    ClampUniforms = initUniforms(uiClampProgram);
+    MorphUniforms = initUniforms(uiMorphProgram);
+    EmitUniforms = initUniforms(uiEmitProgram);
+    glUseProgram(0);
+
+    uiBoundsSSBO = CreateStorageBuffer(sizeof(glm::vec4) * bounds.size(), bounds.data(), GL_STATIC_DRAW);
+    uiErrorsSSBO = CreateStorageBuffer(sizeof(float) * errors.size(), errors.data(), GL_STATIC_DRAW);
+    uiVariantsSSBO = CreateStorageBuffer(sizeof(GLuint) * variants.size(), variants.data(), GL_STATIC_DRAW);
+    uiLODSSBO[0] = CreateStorageBuffer(sizeof(GLint) * iNumPatches, nullptr, GL_DYNAMIC_COPY);
+    uiLODSSBO[1] = CreateStorageBuffer(sizeof(GLint) * iNumPatches, nullptr, GL_DYNAMIC_COPY);
+    uiMorphSSBO = CreateStorageBuffer(sizeof(float) * iNumPatches, nullptr, GL_DYNAMIC_COPY);
+    // 不可见补丁的形变数据不更新，初始为 0
+    std::vector<glm::vec4> patchData((size_t)iNumPatches * 2, glm::vec4(0.0f));
+    uiPatchDataSSBO = CreateStorageBuffer(sizeof(glm::vec4) * patchData.size(), patchData.data(), GL_DYNAMIC_COPY);
+    uiCommandSSBO = CreateStorageBuffer(sizeof(GLuint) * 5 * iNumPatches, nullptr, GL_DYNAMIC_COPY);
+    uiCounterSSBO = CreateStorageBuffer(sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    return true;
+}
+
+void GpuPatchCuller::release()
+{
+    GLuint programs[4] = {uiSelectProgram, uiClampProgram, uiMorphProgram, uiEmitProgram};
+    for (int i = 0; i < 4; i++)
+    {
+        if (programs[i])
+        {
+            glDeleteProgram(programs[i]);
+        }
+    }
+    uiSelectProgram = uiClampProgram = uiMorphProgram = uiEmitProgram = 0;
+    GLuint *buffers[9] = {&uiBoundsSSBO, &uiErrorsSSBO, &uiVariantsSSBO, &uiLODSSBO[0], &uiLODSSBO[1], &uiMorphSSBO, &uiPatchDataSSBO, &uiCommandSSBO, &uiCounterSSBO};
+    for (int i = 0; i < 9; i++)
+    {
+        if (*buffers[i])
+        {
+            glDeleteBuffers(1, buffers[i]);
+            *buffers[i] = 0;
+        }
+    }
+    iNumPatches = 0;
+}
+
+GpuPatchCuller::FrameUniforms GpuPatchCuller::initUniforms(GLuint program) const
+{
+    // uniform 的值保存在程序中，补丁数等只需设置一次
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uNumPatches"), iNumPatches);
+    glUniform1i(glGetUniformLocation(program, "uPatchesPerSide"), iNumPatchesPerSide);
+    glUniform1i(glGetUniformLocation(program, "uVertsPerPatch"), iVertsPerPatch);
+    glUniform1i(glGetUniformLocation(program, "uMaxLOD"), iMaxLOD);
+
+    FrameUniforms uniforms;
+    uniforms.iPlanesLoc = glGetUniformLocation(program, "uPlanes");
+    uniforms.iEyeLoc = glGetUniformLocation(program, "uEye");
+    uniforms.iPixelsPerUnitLoc = glGetUniformLocation(program, "uPixelsPerUnit");
+    uniforms.iPixelErrorLoc = glGetUniformLocation(program, "uPixelError");
+    uniforms.iMorphRangeLoc = glGetUniformLocation(program, "uMorphRange");
+    uniforms.iGeomorphLoc = glGetUniformLocation(program, "uGeomorph");
+    return uniforms;
+}
+
+void GpuPatchCuller::setUniforms(GLuint program, const FrameUniforms &uniforms, const Frustum &frustum, const glm::vec3 &eye_position, float fPixelsPerUnit, float fPixelError, float fMorphRange, bool bGeomorph)
+{
+    glUseProgram(program);
+    glUniform4fv(uniforms.iPlanesLoc, 6, &frustum.planes[0].x);
+    glUniform3f(uniforms.iEyeLoc, eye_position.x, eye_position.y, eye_position.z);
+    glUniform1f(uniforms.iPixelsPerUnitLoc, fPixelsPerUnit);
+    glUniform1f(uniforms.iPixelErrorLoc, fPixelError);
+    glUniform1f(uniforms.iMorphRangeLoc, fMorphRange);
+    glUniform1i(uniforms.iGeomorphLoc, bGeomorph ? 1 : 0);
+}
+
+void GpuPatchCuller::cull(const Frustum &frustum, const glm::vec3 &eye_position, float fPixelsPerUnit, float fPixelError, float fMorphRange, bool bGeomorph)
+{
+    if (!isReady())
+    {
+        return;
+    }
+    GLint iPrevProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &iPrevProgram);
+
+    // 不支持按缓冲区中的绘制数提交时按补丁总数提交，多余的命令清零后不绘制任何东西
+    GLuint uiZero = 0;
+    if (!GLAD_GL_VERSION_4_6 && !GLAD_GL_ARB_indirect_parameters)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiCommandSSBO);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiZero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiCounterSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiZero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, uiBoundsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, uiErrorsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, uiVariantsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, uiMorphSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, uiPatchDataSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, uiCommandSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, uiCounterSSBO);
+    GLuint groups = (GLuint)((iNumPatches + GPU_CULL_GROUP - 1) / GPU_CULL_GROUP);
+
+    // 裁剪与等级选择，结果写入 0 号等级缓冲区
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, uiLODSSBO[0]);
+    setUniforms(uiSelectProgram, SelectUniforms, frustum, eye_position, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 约束传播，两个等级缓冲区交替读写
+    int iCurrent = 0;
+    setUniforms(uiClampProgram, ClampUniforms, frustum, eye_position, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+    for (int pass = 0; pass < iMaxLOD; pass++)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, uiLODSSBO[iCurrent]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, uiLODSSBO[1 - iCurrent]);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        iCurrent = 1 - iCurrent;
+    }
+    iFinalLODs = iCurrent;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, uiLODSSBO[iCurrent]);
+
+    if (bGeomorph)
+    {
+        setUniforms(uiMorphProgram, MorphUniforms, frustum, eye_position, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    setUniforms(uiEmitProgram, EmitUniforms, frustum, eye_position, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+    glDispatchCompute(groups, 1, 1);
+    // 之后作为间接绘制命令、绘制数和纹理缓冲区读取
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram((GLuint)iPrevProgram);
+}
+
+void GpuPatchCuller::draw()
+{
+    if (!isReady())
+    {
+        return;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, uiCommandSSBO);
+    if (GLAD_GL_VERSION_4_6 || GLAD_GL_ARB_indirect_parameters)
+    {
+        glBindBuffer(GL_PARAMETER_BUFFER, uiCounterSSBO);
+        if (GLAD_GL_VERSION_4_6)
+        {
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, 0, iNumPatches, 0);
+        }
+        else
+        {
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, 0, iNumPatches, 0);
+        }
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    }
+    else
+    {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, iNumPatches, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuPatchCuller::readback(std::vector<int> &lods, GLuint &uiDrawCount) const
+{
+    lods.resize(iNumPatches);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiLODSSBO[iFinalLODs]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLint) * iNumPatches, lods.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiCounterSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &uiDrawCount);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
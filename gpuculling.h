@@ -0,0 +1,91 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frustum.h"
+
+//----------------------------------------------------------------------
+// GPU 上的补丁裁剪与等级选择（GL 4.3）
+// 补丁包围盒、几何误差、各等级各接缝版本的索引范围放在 SSBO 中，每帧由计算着色器完成：
+// 视锥体裁剪与按屏幕空间误差选择等级 -> 相邻补丁等级差不超过 1 的约束 -> 形变系数 -> 接缝版本与间接绘制命令，
+// 最后用 glMultiDrawElementsIndirect 一次提交，CPU 每帧的开销与补丁数无关。
+// 结果与 LandScapeMap 在 CPU 上的选择一致（浮点误差范围内）
+//----------------------------------------------------------------------
+class GpuPatchCuller
+{
+public:
+    GpuPatchCuller();
+    ~GpuPatchCuller();
+
+    // 当前上下文是否支持计算着色器与间接绘制
+    static bool isSupported();
+
+    //----------------------------------------------------------------------
+    // 上传不随帧变化的数据
+    // bounds: 每个补丁 2 个 vec4，包围盒最小点、最大点（xyz）
+    // errors: 每个补丁 iMaxLOD + 1 个几何误差
+    // variants: 每个等级 16 个接缝版本，各 2 个数：索引数量、在共享索引缓冲区中的起始索引
+    //----------------------------------------------------------------------
+    bool init(int iNumPatchesPerSide, int iVertsPerPatch, int iMaxLOD, const std::vector<glm::vec4> &bounds, const std::vector<float> &errors, const std::vector<GLuint> &variants);
+    void release();
+
+    bool isReady() const { return uiEmitProgram != 0; }
+
+    //----------------------------------------------------------------------
+    // 生成本帧的间接绘制命令与补丁形变数据，参数含义同 LandScapeMap::render
+    // 结束时恢复调用前的着色器程序
+    //----------------------------------------------------------------------
+    void cull(const Frustum &frustum, const glm::vec3 &eye_position, float fPixelsPerUnit, float fPixelError, float fMorphRange, bool bGeomorph);
+
+    // 提交本帧的绘制，调用前绑定好 VAO（含共享索引缓冲区）与地形着色器
+    void draw();
+
+    // 每个补丁 2 个 vec4 的等级与形变数据，布局与 LandScapeMap::PatchMorphData 相同，可以作为纹理缓冲区
+    GLuint getPatchDataBuffer() const { return uiPatchDataSSBO; }
+
+    // 读回每个补丁的等级（不可见为 -1）与本帧的绘制数，只用于调试和测试
+    void readback(std::vector<int> &lods, GLuint &uiDrawCount) const;
+
+private:
+    GpuPatchCuller(const GpuPatchCuller &);
+    GpuPatchCuller &operator=(const GpuPatchCuller &);
+
+    // 一个程序每帧变化的 uniform 位置，init 时查询一次
+    struct FrameUniforms
+    {
+        GLint iPlanesLoc;
+        GLint iEyeLoc;
+        GLint iPixelsPerUnitLoc;
+        GLint iPixelErrorLoc;
+        GLint iMorphRangeLoc;
+        GLint iGeomorphLoc;
+    };
+
+    // 设置不随帧变化的 uniform，并查询每帧变化的 uniform 位置
+    FrameUniforms initUniforms(GLuint program) const;
+    void setUniforms(GLuint program, const FrameUniforms &uniforms, const Frustum &frustum, const glm::vec3 &eye_position, float fPixelsPerUnit, float fPixelError, float fMorphRange, bool bGeomorph);
+
+    int iNumPatches;
+    int iNumPatchesPerSide;
+    int iVertsPerPatch;
+    int iMaxLOD;
+    int iFinalLODs; // 最后一次约束之后等级所在的缓冲区（0 或 1）
+
+    GLuint uiBoundsSSBO;
+    GLuint uiErrorsSSBO;
+    GLuint uiVariantsSSBO;
+    GLuint uiLODSSBO[2]; // 约束传播时交替读写
+    GLuint uiMorphSSBO;
+    GLuint uiPatchDataSSBO;
+    GLuint uiCommandSSBO; // 同时作为 GL_DRAW_INDIRECT_BUFFER
+    GLuint uiCounterSSBO; // 绘制数，支持 ARB_indirect_parameters 时作为 GL_PARAMETER_BUFFER
+
+    GLuint uiSelectProgram;
+    GLuint uiClampProgram;
+    GLuint uiMorphProgram;
+    GLuint uiEmitProgram;
+    FrameUniforms SelectUniforms;
+    FrameUniforms ClampUniforms;
+    FrameUniforms MorphUniforms;
+    FrameUniforms EmitUniforms;
+};
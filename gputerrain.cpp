@@ -0,0 +1,489 @@
+#include "gputerrain.h"
+#include "glutil.h"
+#include "terrain_util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// 二维计算着色器的工作组大小
+#define GPU_TERRAIN_GROUP 16
+
+//----------------------------------------------------------------------
+// 断层：每个纹素依次累加一批断层线，判断条件与 CPU 版本相同
+//----------------------------------------------------------------------
+static const char *faultShaderSource = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(r32f, binding = 0) uniform image2D uWork;
+// 每条断层线：(x1, z1, dirX, dirZ) 与抬高的高度
+struct Fault { ivec4 line; float height; };
+layout(std430, binding = 0) readonly buffer Faults { Fault faults[]; };
+uniform int uSize;
+uniform int uFirst;
+uniform int uCount;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= uSize || p.y >= uSize)
+        return;
+    precise float h = imageLoad(uWork, p).r;
+    for (int f = uFirst; f < uFirst + uCount; f++)
+    {
+        ivec4 l = faults[f].line;
+        if ((p.x - l.x) * l.w - l.z * (p.y - l.y) > 0)
+            h += faults[f].height;
+    }
+    imageStore(uWork, p, vec4(h));
+}
+)";
+
+//----------------------------------------------------------------------
+// 侵蚀滤波：每个线程处理一整行（uColumns = 0）或一整列，先正向再反向
+//----------------------------------------------------------------------
+static const char *filterShaderSource = R"(
+layout(local_size_x = 64) in;
+layout(r32f, binding = 0) uniform image2D uWork;
+uniform int uSize;
+uniform int uColumns;
+uniform float uFilter;
+
+void main()
+{
+    int band = int(gl_GlobalInvocationID.x);
+    if (band >= uSize)
+        return;
+    ivec2 axis = uColumns != 0 ? ivec2(0, 1) : ivec2(1, 0);
+    ivec2 origin = uColumns != 0 ? ivec2(band, 0) : ivec2(0, band);
+    precise float keep = 1.0 - uFilter;
+    precise float v = imageLoad(uWork, origin).r;
+    for (int i = 1; i < uSize; i++)
+    {
+        ivec2 p = origin + axis * i;
+        precise float h = uFilter * v + keep * imageLoad(uWork, p).r;
+        imageStore(uWork, p, vec4(h));
+        v = h;
+    }
+    for (int i = uSize - 2; i >= 0; i--)
+    {
+        ivec2 p = origin + axis * i;
+        precise float h = uFilter * v + keep * imageLoad(uWork, p).r;
+        imageStore(uWork, p, vec4(h));
+        v = h;
+    }
+}
+)";
+
+//----------------------------------------------------------------------
+// fBm 梯度噪声，哈希与 terrain_noise.cpp 相同
+//----------------------------------------------------------------------
+static const char *noiseShaderSource = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(r32f, binding = 0) uniform image2D uWork;
+// 每个八度：(频率, 振幅, 种子, 0)
+layout(std430, binding = 0) readonly buffer Octaves { uvec4 octaves[]; };
+uniform int uSize;
+uniform int uOctaves;
+
+uint hashLattice(uint ix, uint iz, uint seed)
+{
+    uint h = (ix * 0x8DA6B343u) ^ (iz * 0xD8163841u) ^ seed;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+float gradientDot(uint h, float dx, float dz)
+{
+    return ((h & 1u) != 0u ? -dx : dx) + ((h & 2u) != 0u ? -dz : dz);
+}
+
+float fade(float t)
+{
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= uSize || p.y >= uSize)
+        return;
+    precise float h = 0.0;
+    for (int o = 0; o < uOctaves; o++)
+    {
+        float scale = uintBitsToFloat(octaves[o].x) / float(uSize - 1);
+        float amplitude = uintBitsToFloat(octaves[o].y);
+        uint seed = octaves[o].z;
+        vec2 f = vec2(p) * scale;
+        vec2 f0 = floor(f);
+        uvec2 i0 = uvec2(ivec2(f0));
+        vec2 d = f - f0;
+        float n00 = gradientDot(hashLattice(i0.x, i0.y, seed), d.x, d.y);
+        float n10 = gradientDot(hashLattice(i0.x + 1u, i0.y, seed), d.x - 1.0, d.y);
+        float n01 = gradientDot(hashLattice(i0.x, i0.y + 1u, seed), d.x, d.y - 1.0);
+        float n11 = gradientDot(hashLattice(i0.x + 1u, i0.y + 1u, seed), d.x - 1.0, d.y - 1.0);
+        float wx = fade(d.x);
+        float nx0 = n00 + wx * (n10 - n00);
+        float nx1 = n01 + wx * (n11 - n01);
+        h += amplitude * (nx0 + fade(d.y) * (nx1 - nx0));
+    }
+    imageStore(uWork, p, vec4(h));
+}
+)";
+
+//----------------------------------------------------------------------
+// 求最小、最大值：工作组内先用共享内存归约，再原子合并到 SSBO
+// 浮点数映射为保持大小顺序的无符号整数后再做原子比较
+//----------------------------------------------------------------------
+static const char *rangeShaderSource = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(r32f, binding = 0) uniform readonly image2D uWork;
+layout(std430, binding = 1) buffer Range { uint minKey; uint maxKey; };
+uniform int uSize;
+shared uint sMin[256];
+shared uint sMax[256];
+
+uint orderedKey(float f)
+{
+    uint u = floatBitsToUint(f);
+    return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    uint local = gl_LocalInvocationIndex;
+    uint key = orderedKey(imageLoad(uWork, min(p, ivec2(uSize - 1))).r);
+    sMin[local] = key;
+    sMax[local] = key;
+    barrier();
+    for (uint stride = 128u; stride > 0u; stride >>= 1)
+    {
+        if (local < stride)
+        {
+            sMin[local] = min(sMin[local], sMin[local + stride]);
+            sMax[local] = max(sMax[local], sMax[local + stride]);
+        }
+        barrier();
+    }
+    if (local == 0u)
+    {
+        atomicMin(minKey, sMin[0]);
+        atomicMax(maxKey, sMax[0]);
+    }
+}
+)";
+
+//----------------------------------------------------------------------
+// 归一化到 [0, 1] 并写入高度纹理，HEIGHT_FORMAT 为 r16 或 r32f
+//----------------------------------------------------------------------
+static const char *normalizeShaderSource = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(r32f, binding = 0) uniform readonly image2D uWork;
+layout(HEIGHT_FORMAT, binding = 1) uniform writeonly image2D uHeight;
+layout(std430, binding = 1) readonly buffer Range { uint minKey; uint maxKey; };
+uniform int uSize;
+
+float orderedValue(uint key)
+{
+    return uintBitsToFloat((key & 0x80000000u) != 0u ? key & 0x7FFFFFFFu : ~key);
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= uSize || p.y >= uSize)
+        return;
+    float fMin = orderedValue(minKey);
+    float fMax = orderedValue(maxKey);
+    float h = fMax > fMin ? (imageLoad(uWork, p).r - fMin) / (fMax - fMin) : 0.0;
+    imageStore(uHeight, p, vec4(h));
+}
+)";
+
+GpuTerrain::GpuTerrain()
+    : iSize(0), eFormat(GL_R16), uiWorkTex(0), uiHeightTex(0), uiDataSSBO(0), uiRangeSSBO(0),
+      uiFaultProgram(0), uiFilterProgram(0), uiNoiseProgram(0), uiRangeProgram(0), uiNormalizeProgram(0)
+{
+}
+
+GpuTerrain::~GpuTerrain()
+{
+    release();
+}
+
+bool GpuTerrain::isSupported()
+{
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool GpuTerrain::init(int iSize, GLenum eFormat)
+{
+    release();
+    if (!isSupported())
+    {
+        std::cerr << "Compute shaders require OpenGL 4.3" << std::endl;
+        return false;
+    }
+    if (eFormat != GL_R16 && eFormat != GL_R32F)
+    {
+        std::cerr << "Unsupported height texture format: " << eFormat << std::endl;
+        return false;
+    }
+    this->iSize = iSize;
+    this->eFormat = eFormat;
+
+    uiFaultProgram = CompileComputeProgram(faultShaderSource);
+    uiFilterProgram = CompileComputeProgram(filterShaderSource);
+    uiNoiseProgram = CompileComputeProgram(noiseShaderSource);
+    uiRangeProgram = CompileComputeProgram(rangeShaderSource);
+    uiNormalizeProgram = CompileComputeProgram(normalizeShaderSource, eFormat == GL_R16 ? "#define HEIGHT_FORMAT r16\n" : "#define HEIGHT_FORMAT r32f\n");
+    if (!uiFaultProgram || !uiFilterProgram || !uiNoiseProgram || !uiRangeProgram || !uiNormalizeProgram)
+    {
+        release();
+        return false;
+    }
+
+    // 不可变存储的纹理，只有一层 mipmap
+    glGenTextures(1, &uiWorkTex);
+    glBindTexture(GL_TEXTURE_2D, uiWorkTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, iSize, iSize);
+
+    glGenTextures(1, &uiHeightTex);
+    glBindTexture(GL_TEXTURE_2D, uiHeightTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, eFormat, iSize, iSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &uiDataSSBO);
+    glGenBuffers(1, &uiRangeSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiRangeSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
+
+void GpuTerrain::release()
+{
+    GLuint programs[5] = {uiFaultProgram, uiFilterProgram, uiNoiseProgram, uiRangeProgram, uiNormalizeProgram};
+    for (int i = 0; i < 5; i++)
+    {
+        if (programs[i])
+        {
+            glDeleteProgram(programs[i]);
+        }
+    }
+    uiFaultProgram = uiFilterProgram = uiNoiseProgram = uiRangeProgram = uiNormalizeProgram = 0;
+    if (uiWorkTex)
+    {
+        glDeleteTextures(1, &uiWorkTex);
+        uiWorkTex = 0;
+    }
+    if (uiHeightTex)
+    {
+        glDeleteTextures(1, &uiHeightTex);
+        uiHeightTex = 0;
+    }
+    if (uiDataSSBO)
+    {
+        glDeleteBuffers(1, &uiDataSSBO);
+        uiDataSSBO = 0;
+    }
+    if (uiRangeSSBO)
+    {
+        glDeleteBuffers(1, &uiRangeSSBO);
+        uiRangeSSBO = 0;
+    }
+    iSize = 0;
+}
+
+//----------------------------------------------------------------------
+// 覆盖整张纹理的二维调度
+//----------------------------------------------------------------------
+void GpuTerrain::dispatch2D(GLuint program)
+{
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uSize"), iSize);
+    GLuint groups = (GLuint)((iSize + GPU_TERRAIN_GROUP - 1) / GPU_TERRAIN_GROUP);
+    glDispatchCompute(groups, groups, 1);
+}
+
+void GpuTerrain::generateFault(int iIterations, int iMinDelta, int iMaxDelta, float fFilter, uint64_t uiSeed, int iFilterInterval)
+{
+    if (!uiFaultProgram || iIterations <= 0)
+    {
+        return;
+    }
+    // 断层线在 CPU 上由种子生成（只有几千条），高度场本身只在 GPU 上
+    std::vector<STRN_FAULT_LINE> faults = CTERRAIN::MakeFaultLines(iSize, iIterations, iMinDelta, iMaxDelta, uiSeed);
+    // std430 下 Fault 结构按 16 字节对齐，每条占 8 个 32 位数
+    std::vector<GLint> data(faults.size() * 8, 0);
+    for (size_t f = 0; f < faults.size(); f++)
+    {
+        data[f * 8] = faults[f].iX1;
+        data[f * 8 + 1] = faults[f].iZ1;
+        data[f * 8 + 2] = faults[f].iDirX;
+        data[f * 8 + 3] = faults[f].iDirZ;
+        memcpy(&data[f * 8 + 4], &faults[f].fHeight, sizeof(float));
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiDataSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLint) * data.size(), data.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, uiDataSSBO);
+
+    float fZero = 0.0f;
+    glClearTexImage(uiWorkTex, 0, GL_RED, GL_FLOAT, &fZero);
+    glBindImageTexture(0, uiWorkTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    // 与 CPU 版本相同：每 iFilterInterval 条断层过滤一次，最后一条之后总会过滤
+    int iFirst = 0;
+    for (int it = 0; it < iIterations; it++)
+    {
+        if (!((iFilterInterval > 0 && (it + 1) % iFilterInterval == 0) || it == iIterations - 1))
+        {
+            continue;
+        }
+        glUseProgram(uiFaultProgram);
+        glUniform1i(glGetUniformLocation(uiFaultProgram, "uFirst"), iFirst);
+        glUniform1i(glGetUniformLocation(uiFaultProgram, "uCount"), it + 1 - iFirst);
+        dispatch2D(uiFaultProgram);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        filter(fFilter);
+        iFirst = it + 1;
+    }
+    normalize();
+}
+
+void GpuTerrain::generateNoise(const std::vector<STRN_NOISE_OCTAVE> &octaves, uint64_t uiSeed)
+{
+    if (!uiNoiseProgram)
+    {
+        return;
+    }
+    // 每个八度的哈希种子与 CTERRAIN::MakeTerrainNoise 相同
+    std::vector<GLuint> data(octaves.size() * 4, 0);
+    for (size_t o = 0; o < octaves.size(); o++)
+    {
+        uint64_t uiState = uiSeed + o;
+        memcpy(&data[o * 4], &octaves[o].fFrequency, sizeof(float));
+        memcpy(&data[o * 4 + 1], &octaves[o].fAmplitude, sizeof(float));
+        data[o * 4 + 2] = (GLuint)SplitMix64(uiState);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiDataSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * (data.empty() ? 4 : data.size()), data.empty() ? nullptr : data.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, uiDataSSBO);
+
+    glBindImageTexture(0, uiWorkTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glUseProgram(uiNoiseProgram);
+    glUniform1i(glGetUniformLocation(uiNoiseProgram, "uOctaves"), (GLint)octaves.size());
+    dispatch2D(uiNoiseProgram);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    normalize();
+}
+
+//----------------------------------------------------------------------
+// 侵蚀滤波：所有行做完后再做所有列
+//----------------------------------------------------------------------
+void GpuTerrain::filter(float fFilter)
+{
+    glUseProgram(uiFilterProgram);
+    glUniform1i(glGetUniformLocation(uiFilterProgram, "uSize"), iSize);
+    glUniform1f(glGetUniformLocation(uiFilterProgram, "uFilter"), fFilter);
+    GLuint groups = (GLuint)((iSize + 63) / 64);
+    for (int columns = 0; columns < 2; columns++)
+    {
+        glUniform1i(glGetUniformLocation(uiFilterProgram, "uColumns"), columns);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+}
+
+//----------------------------------------------------------------------
+// 把工作纹理归一化到 [0, 1] 写入高度纹理
+//----------------------------------------------------------------------
+void GpuTerrain::normalize()
+{
+    // 最小值初始为最大的键，最大值初始为最小的键
+    GLuint range[2] = {0xFFFFFFFFu, 0u};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, uiRangeSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(range), range);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, uiRangeSSBO);
+
+    glBindImageTexture(0, uiWorkTex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    dispatch2D(uiRangeProgram);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glBindImageTexture(1, uiHeightTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, eFormat);
+    dispatch2D(uiNormalizeProgram);
+    // 之后由顶点着色器采样或读回
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+bool GpuTerrain::readback(std::vector<float> &heights) const
+{
+    if (!uiHeightTex)
+    {
+        return false;
+    }
+    heights.resize((size_t)iSize * iSize);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, uiHeightTex);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, heights.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 逐点比较读回的高度与 CPU 生成的高度，返回最大误差
+//----------------------------------------------------------------------
+static float CompareHeights(const std::vector<float> &heights, const CTERRAIN &terrain, int iSize)
+{
+    float fMaxError = 0.0f;
+    for (int z = 0; z < iSize; z++)
+    {
+        for (int x = 0; x < iSize; x++)
+        {
+            fMaxError = std::max(fMaxError, std::fabs(heights[(size_t)z * iSize + x] - terrain.GetNormalizedHeightAtPoint(x, z)));
+        }
+    }
+    return fMaxError;
+}
+
+bool GpuTerrain::selfTest(int iSize, float fTolerance)
+{
+    const uint64_t uiSeed = 7;
+    GpuTerrain gpuTerrain;
+    if (!gpuTerrain.init(iSize, GL_R16))
+    {
+        return false;
+    }
+    std::vector<float> heights;
+
+    // 断层：每 4 条过滤一次，覆盖中间过滤和最后一次过滤
+    CTERRAIN faultTerrain;
+    faultTerrain.SetHeightBits(16);
+    faultTerrain.MakeTerrainFault(iSize, 64, 0, 255, 0.3f, uiSeed, 2, 4);
+    gpuTerrain.generateFault(64, 0, 255, 0.3f, uiSeed, 4);
+    gpuTerrain.readback(heights);
+    float fFaultError = CompareHeights(heights, faultTerrain, iSize);
+
+    CTERRAIN noiseTerrain;
+    noiseTerrain.SetHeightBits(16);
+    std::vector<STRN_NOISE_OCTAVE> octaves = CTERRAIN::MakeNoiseOctaves(6, 4.0f);
+    noiseTerrain.MakeTerrainNoise(iSize, octaves, uiSeed, 2);
+    gpuTerrain.generateNoise(octaves, uiSeed);
+    gpuTerrain.readback(heights);
+    float fNoiseError = CompareHeights(heights, noiseTerrain, iSize);
+
+    GLenum eError = glGetError();
+    bool bPassed = fFaultError <= fTolerance && fNoiseError <= fTolerance && eError == GL_NO_ERROR;
+    std::cout << "GpuTerrain self test (" << iSize << "x" << iSize << "): fault max error " << fFaultError << ", noise max error " << fNoiseError
+              << ", GL error " << eError << (bPassed ? ", passed" : ", FAILED") << std::endl;
+    return bPassed;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include "terrain.h"
+
+//----------------------------------------------------------------------
+// 用计算着色器生成地形，结果直接写入高度纹理，顶点着色器可以采样该纹理做位移，CPU 不接触高度数据
+// 断层线与各八度的种子与 CTERRAIN 的生成方式相同，同样的种子得到同样的地形（浮点误差范围内）
+// 需要 GL 4.3（计算着色器、image load/store、SSBO），可以在 Mesa llvmpipe 上运行
+//----------------------------------------------------------------------
+class GpuTerrain
+{
+public:
+    GpuTerrain();
+    ~GpuTerrain();
+
+    // 当前上下文是否支持计算着色器
+    static bool isSupported();
+
+    //----------------------------------------------------------------------
+    // 创建 iSize x iSize 的高度纹理
+    // eFormat: GL_R16（归一化 16 位）或 GL_R32F
+    //----------------------------------------------------------------------
+    bool init(int iSize, GLenum eFormat = GL_R16);
+    void release();
+
+    // 断层生成，参数同 CTERRAIN::MakeTerrainFault
+    void generateFault(int iIterations, int iMinDelta, int iMaxDelta, float fFilter, uint64_t uiSeed, int iFilterInterval = 1);
+
+    // fBm 噪声生成，参数同 CTERRAIN::MakeTerrainNoise
+    void generateNoise(const std::vector<STRN_NOISE_OCTAVE> &octaves, uint64_t uiSeed);
+
+    // 高度纹理，取值范围 [0, 1]
+    GLuint getTexture() const { return uiHeightTex; }
+    int getSize() const { return iSize; }
+
+    // 把高度读回 CPU，只用于调试和测试
+    bool readback(std::vector<float> &heights) const;
+
+    //----------------------------------------------------------------------
+    // 自检：用固定种子分别在 GPU 和 CTERRAIN 上生成断层与噪声地形，逐点比较归一化高度
+    // 要求当前线程有 GL 4.3 上下文，输出每项的最大误差，全部在 fTolerance 以内时返回 true
+    //----------------------------------------------------------------------
+    static bool selfTest(int iSize = 257, float fTolerance = 1.0f / 1024.0f);
+
+private:
+    GpuTerrain(const GpuTerrain &);
+    GpuTerrain &operator=(const GpuTerrain &);
+
+    void filter(float fFilter);
+    void normalize();
+    void dispatch2D(GLuint program);
+
+    int iSize;
+    GLenum eFormat;
+    GLuint uiWorkTex;   // 生成过程中使用的 R32F 纹理
+    GLuint uiHeightTex; // 归一化后的高度纹理
+    GLuint uiDataSSBO;  // 断层线或八度参数
+    GLuint uiRangeSSBO; // 最小、最大值
+
+    GLuint uiFaultProgram;
+    GLuint uiFilterProgram;
+    GLuint uiNoiseProgram;
+    GLuint uiRangeProgram;
+    GLuint uiNormalizeProgram;
+};
@@ -0,0 +1,241 @@
+#include "heightmap.h"
+#include "jobsystem.h"
+#include "tiffio.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+//----------------------------------------------------------------------
+// 把 count 个 T 类型的采样原地展开为 float
+// 采样从 dst 开头紧密存放，float 不比采样小，因此从后往前转换不会覆盖还没读到的采样
+// 采样用 memcpy 按字节读出，不通过 T 类型的指针访问 float 存储，避免违反严格别名规则
+//----------------------------------------------------------------------
+template <typename T>
+static void ExpandSamples(float *dst, size_t count, float fScale)
+{
+    const unsigned char *src = (const unsigned char *)dst;
+    for (size_t k = count; k-- > 0;)
+    {
+        T value;
+        memcpy(&value, src + k * sizeof(T), sizeof(T));
+        dst[k] = (float)value * fScale;
+    }
+}
+
+//----------------------------------------------------------------------
+// 按采样格式把 dst 开头的 count 个原始采样转换为 float
+//----------------------------------------------------------------------
+static bool ConvertSamples(float *dst, size_t count, uint16_t bitsPerSample, uint16_t sampleFormat)
+{
+    if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+    {
+        // 32 位浮点直接解码到目标位置，无需转换
+        return bitsPerSample == 32;
+    }
+    bool bSigned = sampleFormat == SAMPLEFORMAT_INT;
+    switch (bitsPerSample)
+    {
+    case 8:
+        bSigned ? ExpandSamples<int8_t>(dst, count, 1.0f / 127.0f) : ExpandSamples<uint8_t>(dst, count, 1.0f / 255.0f);
+        return true;
+    case 16:
+        bSigned ? ExpandSamples<int16_t>(dst, count, 1.0f / 32767.0f) : ExpandSamples<uint16_t>(dst, count, 1.0f / 65535.0f);
+        return true;
+    case 32:
+        bSigned ? ExpandSamples<int32_t>(dst, count, 1.0f / 2147483647.0f) : ExpandSamples<uint32_t>(dst, count, 1.0f / 4294967295.0f);
+        return true;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------
+// 读取高度图
+// 主线程只读取文件头；每个解码线程打开自己的 TIFF 句柄（libtiff 句柄不能跨线程共享），
+// 从共享计数器领取条带/分块。条带直接解码到 HeightData 中对应的行，分块解码后按行拷贝
+//----------------------------------------------------------------------
+HeightMap::HeightMap(const char *filename, int iThreads)
+    : Width(0), Height(0)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+    {
+        std::cerr << "Error opening TIFF file: " << filename << std::endl;
+        return;
+    }
+
+    SampleLayout layout;
+    uint16_t samplesPerPixel = 1;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &Width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &Height);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &layout.bitsPerSample);
+    // 没有 SampleFormat 标签时 TIFFGetFieldDefaulted 给出 SAMPLEFORMAT_UINT，但旧的读取器把所有 32 位高度图当作浮点，
+    // 不带标签的 32 位浮点 DEM 很常见，因此此时仍按浮点读取
+    if (!TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &layout.sampleFormat))
+    {
+        layout.sampleFormat = layout.bitsPerSample == 32 ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT;
+        if (layout.bitsPerSample == 32)
+        {
+            std::cerr << "TIFF has no SampleFormat tag, reading 32-bit samples as float: " << filename << std::endl;
+        }
+    }
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    layout.bTiled = TIFFIsTiled(tif) != 0;
+    layout.rowsPerStrip = Height;
+    layout.tileWidth = 0;
+    layout.tileLength = 0;
+    if (layout.bTiled)
+    {
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &layout.tileWidth);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &layout.tileLength);
+        layout.numChunks = TIFFNumberOfTiles(tif);
+    }
+    else
+    {
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &layout.rowsPerStrip);
+        layout.rowsPerStrip = std::min(layout.rowsPerStrip, Height);
+        layout.numChunks = TIFFNumberOfStrips(tif);
+    }
+    TIFFClose(tif);
+
+    bool bSupported = samplesPerPixel == 1 &&
+                      (layout.bitsPerSample == 8 || layout.bitsPerSample == 16 || layout.bitsPerSample == 32) &&
+                      (layout.sampleFormat == SAMPLEFORMAT_UINT || layout.sampleFormat == SAMPLEFORMAT_INT || (layout.sampleFormat == SAMPLEFORMAT_IEEEFP && layout.bitsPerSample == 32));
+    if (!bSupported || Width == 0 || Height == 0 || layout.numChunks == 0)
+    {
+        std::cerr << "Unsupported TIFF sample layout: " << layout.bitsPerSample << " bits, format " << layout.sampleFormat
+                  << ", " << samplesPerPixel << " samples per pixel" << std::endl;
+        Width = Height = 0;
+        return;
+    }
+
+    HeightData.resize((size_t)Width * Height);
+
+    if (iThreads <= 0)
+    {
+        iThreads = JobSystem::instance().getConcurrency();
+    }
+    iThreads = (int)std::min<uint32_t>((uint32_t)iThreads, layout.numChunks);
+
+    std::atomic<uint32_t> nextChunk(0);
+    std::atomic<bool> bFailed(false);
+    auto worker = [&]()
+    {
+        TIFF *local = TIFFOpen(filename, "r");
+        if (local == NULL)
+        {
+            bFailed = true;
+            return;
+        }
+        std::vector<unsigned char> scratch;
+        for (uint32_t chunk = nextChunk++; chunk < layout.numChunks && !bFailed; chunk = nextChunk++)
+        {
+            if (!decodeChunk(local, layout, chunk, scratch))
+            {
+                bFailed = true;
+            }
+        }
+        TIFFClose(local);
+    };
+
+    // 每个任务打开自己的文件句柄，从共享计数器领取条带或分块
+    JobSystem::instance().parallelFor(iThreads, 1, [&](int iBegin, int iEnd)
+                                      {
+        for (int t = iBegin; t < iEnd; t++)
+        {
+            worker();
+        } });
+
+    if (bFailed)
+    {
+        std::cerr << "Error decoding TIFF file: " << filename << std::endl;
+        release();
+        Width = Height = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// 解码一个条带或分块
+// scratch: 线程自己的分块缓冲区，条带不需要
+//----------------------------------------------------------------------
+bool HeightMap::decodeChunk(TIFF *tif, const SampleLayout &layout, uint32_t chunk, std::vector<unsigned char> &scratch)
+{
+    size_t bytesPerSample = layout.bitsPerSample / 8;
+    if (!layout.bTiled)
+    {
+        // 条带覆盖的行直接作为解码目标，解码后原地展开为 float
+        uint32_t row0 = chunk * layout.rowsPerStrip;
+        if (row0 >= Height)
+        {
+            return true;
+        }
+        uint32_t rows = std::min(layout.rowsPerStrip, Height - row0);
+        size_t count = (size_t)rows * Width;
+        float *dst = &HeightData[(size_t)row0 * Width];
+        if (TIFFReadEncodedStrip(tif, chunk, dst, (tmsize_t)(count * bytesPerSample)) < 0)
+        {
+            return false;
+        }
+        return ConvertSamples(dst, count, layout.bitsPerSample, layout.sampleFormat);
+    }
+
+    // 分块在图像边缘也是完整大小，解码到临时缓冲区后只拷贝有效部分
+    uint32_t tilesAcross = (Width + layout.tileWidth - 1) / layout.tileWidth;
+    uint32_t x0 = (chunk % tilesAcross) * layout.tileWidth;
+    uint32_t y0 = (chunk / tilesAcross) * layout.tileLength;
+    if (x0 >= Width || y0 >= Height)
+    {
+        return true;
+    }
+    size_t tileSamples = (size_t)layout.tileWidth * layout.tileLength;
+    scratch.resize(tileSamples * sizeof(float));
+    if (TIFFReadEncodedTile(tif, chunk, scratch.data(), (tmsize_t)(tileSamples * bytesPerSample)) < 0)
+    {
+        return false;
+    }
+    float *tile = (float *)scratch.data();
+    if (!ConvertSamples(tile, tileSamples, layout.bitsPerSample, layout.sampleFormat))
+    {
+        return false;
+    }
+    uint32_t cols = std::min(layout.tileWidth, Width - x0);
+    uint32_t rows = std::min(layout.tileLength, Height - y0);
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        memcpy(&HeightData[(size_t)(y0 + r) * Width + x0], &tile[(size_t)r * layout.tileWidth], cols * sizeof(float));
+    }
+    return true;
+}
+
+HeightMap::~HeightMap()
+{
+    HeightData.clear();
+}
+
+//----------------------------------------------------------------------
+// 释放高度数据
+//----------------------------------------------------------------------
+void HeightMap::release()
+{
+    std::vector<float>().swap(HeightData);
+}
+
+//----------------------------------------------------------------------
+// 获取高度数据的最小值和最大值
+//----------------------------------------------------------------------
+void HeightMap::getRange(float &fMin, float &fMax) const
+{
+    fMin = 0.0f;
+    fMax = 0.0f;
+    if (HeightData.empty())
+    {
+        return;
+    }
+    fMin = fMax = HeightData[0];
+    for (size_t i = 1; i < HeightData.size(); i++)
+    {
+        fMin = std::min(fMin, HeightData[i]);
+        fMax = std::max(fMax, HeightData[i]);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct tiff;
+
+//----------------------------------------------------------------------
+// 从单通道 TIFF 读取的高度图
+// 支持 8/16/32 位有符号、无符号整数以及 32 位浮点采样，按条带或分块并行解码；
+// 整数采样归一化到 [0, 1]（有符号为 [-1, 1]），浮点采样保持原值
+//----------------------------------------------------------------------
+class HeightMap
+{
+public:
+    // iThreads 为解码线程数，0 表示使用全部核心
+    HeightMap(const char *filename, int iThreads = 0);
+    ~HeightMap();
+
+    // 释放高度数据
+    void release();
+
+    // 获取高度数据的最小值和最大值
+    void getRange(float &fMin, float &fMax) const;
+
+    float getHeight(int x, int y) const
+    {
+        if (x < 0 || x >= (int)Width || y < 0 || y >= (int)Height)
+        {
+            return 0.0f; // 返回默认高度
+        }
+        return HeightData[(size_t)y * Width + x];
+    }
+
+    bool isLoaded() const { return !HeightData.empty(); }
+    uint32_t getWidth() const { return Width; }
+    uint32_t getLength() const { return Height; }
+
+private:
+    // 文件的采样格式
+    struct SampleLayout
+    {
+        uint16_t bitsPerSample;
+        uint16_t sampleFormat;
+        bool bTiled;
+        uint32_t rowsPerStrip; // 条带组织时每个条带的行数
+        uint32_t tileWidth;    // 分块组织时块的大小
+        uint32_t tileLength;
+        uint32_t numChunks;    // 条带或分块的数量
+    };
+
+    bool decodeChunk(struct tiff *tif, const SampleLayout &layout, uint32_t chunk, std::vector<unsigned char> &scratch);
+
+    uint32_t Width;
+    uint32_t Height;
+    std::vector<float> HeightData;
+};
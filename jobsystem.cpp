@@ -0,0 +1,334 @@
+#include "jobsystem.h"
+#include <algorithm>
+#include <chrono>
+
+//----------------------------------------------------------------------
+// 一个任务：iPending 为尚未完成的依赖数 + 1（提交本身），减到 0 时进入队列
+//----------------------------------------------------------------------
+struct Job
+{
+    std::function<void()> func;
+    std::atomic<int> iPending;
+    std::atomic<bool> bDone;
+    bool bMainThread;
+    std::mutex mutex;                   // 保护 dependents
+    std::vector<JobHandle> dependents;  // 依赖本任务、尚在等待的任务
+};
+
+// 当前线程所属的调度器与队列，不是工作线程时为空
+static thread_local JobSystem *tlsJobSystem = nullptr;
+static thread_local int tlsQueue = -1;
+
+JobSystem::JobSystem(int iWorkers)
+    : mainThread(std::this_thread::get_id()), iQueued(0), bQuit(false)
+{
+    if (iWorkers <= 0)
+    {
+        iWorkers = (int)std::thread::hardware_concurrency() - 1;
+    }
+    // 至少一个工作线程，主线程不等待时提交的任务也能执行
+    iWorkers = std::max(iWorkers, 1);
+    for (int i = 0; i <= iWorkers; i++)
+    {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (int i = 0; i < iWorkers; i++)
+    {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        bQuit = true;
+    }
+    sleepCondition.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+JobSystem &JobSystem::instance()
+{
+    static JobSystem system;
+    return system;
+}
+
+static JobHandle CreateJob(std::function<void()> func, const std::vector<JobHandle> &deps, bool bMainThread)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->func = std::move(func);
+    job->iPending = (int)deps.size() + 1;
+    job->bDone = false;
+    job->bMainThread = bMainThread;
+    for (size_t i = 0; i < deps.size(); i++)
+    {
+        if (deps[i])
+        {
+            std::lock_guard<std::mutex> lock(deps[i]->mutex);
+            if (!deps[i]->bDone)
+            {
+                deps[i]->dependents.push_back(job);
+                continue;
+            }
+        }
+        job->iPending--;
+    }
+    return job;
+}
+
+JobHandle JobSystem::submit(std::function<void()> func, const std::vector<JobHandle> &deps)
+{
+    JobHandle job = CreateJob(std::move(func), deps, false);
+    if (job->iPending.fetch_sub(1) == 1)
+    {
+        schedule(job);
+    }
+    return job;
+}
+
+JobHandle JobSystem::submitMain(std::function<void()> func, const std::vector<JobHandle> &deps)
+{
+    JobHandle job = CreateJob(std::move(func), deps, true);
+    if (job->iPending.fetch_sub(1) == 1)
+    {
+        schedule(job);
+    }
+    return job;
+}
+
+bool JobSystem::isDone(const JobHandle &job)
+{
+    return !job || job->bDone;
+}
+
+//----------------------------------------------------------------------
+// 依赖全部完成的任务放入队列：工作线程提交的放入自己的队列，其他线程提交的放入公共队列
+//----------------------------------------------------------------------
+void JobSystem::schedule(const JobHandle &job)
+{
+    if (job->bMainThread)
+    {
+        std::lock_guard<std::mutex> lock(mainQueue.mutex);
+        mainQueue.jobs.push_back(job);
+        return;
+    }
+    int iQueue = tlsJobSystem == this ? tlsQueue : (int)workers.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[iQueue]->mutex);
+        queues[iQueue]->jobs.push_back(job);
+    }
+    {
+        // 持有 sleepMutex 修改计数，工作线程检查条件与进入等待之间不会漏掉通知
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        iQueued++;
+    }
+    sleepCondition.notify_one();
+}
+
+//----------------------------------------------------------------------
+// 标记任务完成，依赖它的任务中最后一个依赖完成的进入队列
+//----------------------------------------------------------------------
+void JobSystem::finish(const JobHandle &job)
+{
+    job->func = nullptr; // 尽早释放捕获的数据
+    std::vector<JobHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->bDone = true;
+        dependents.swap(job->dependents);
+    }
+    for (size_t i = 0; i < dependents.size(); i++)
+    {
+        if (dependents[i]->iPending.fetch_sub(1) == 1)
+        {
+            schedule(dependents[i]);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 先从自己队列的队尾取（最近提交的任务数据还在缓存中），再从其他队列的队首窃取
+//----------------------------------------------------------------------
+JobHandle JobSystem::takeJob(int iQueue)
+{
+    int iCount = (int)queues.size();
+    for (int k = 0; k < iCount; k++)
+    {
+        int q = (iQueue + k) % iCount;
+        WorkQueue &queue = *queues[q];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+        {
+            continue;
+        }
+        JobHandle job;
+        if (k == 0)
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        iQueued--;
+        return job;
+    }
+    return JobHandle();
+}
+
+JobHandle JobSystem::takeMainJob()
+{
+    std::lock_guard<std::mutex> lock(mainQueue.mutex);
+    if (mainQueue.jobs.empty())
+    {
+        return JobHandle();
+    }
+    JobHandle job = mainQueue.jobs.front();
+    mainQueue.jobs.pop_front();
+    return job;
+}
+
+bool JobSystem::runOne(int iQueue)
+{
+    JobHandle job = takeJob(iQueue);
+    if (!job)
+    {
+        return false;
+    }
+    job->func();
+    finish(job);
+    return true;
+}
+
+void JobSystem::workerLoop(int iQueue)
+{
+    tlsJobSystem = this;
+    tlsQueue = iQueue;
+    for (;;)
+    {
+        if (runOne(iQueue))
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]
+                            { return bQuit || iQueued > 0; });
+        if (bQuit && iQueued == 0)
+        {
+            return;
+        }
+    }
+}
+
+void JobSystem::wait(const JobHandle &job)
+{
+    int iQueue = tlsJobSystem == this ? tlsQueue : (int)workers.size();
+    bool bMain = isMainThread();
+    while (!isDone(job))
+    {
+        if (bMain)
+        {
+            JobHandle mainJob = takeMainJob();
+            if (mainJob)
+            {
+                mainJob->func();
+                finish(mainJob);
+                continue;
+            }
+        }
+        if (!runOne(iQueue))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::wait(const std::vector<JobHandle> &jobs)
+{
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        wait(jobs[i]);
+    }
+}
+
+void JobSystem::parallelFor(int iCount, int iGrain, const std::function<void(int, int)> &func)
+{
+    if (iCount <= 0)
+    {
+        return;
+    }
+    if (iGrain <= 0)
+    {
+        // 每个线程约 4 段，执行时间不均匀时可以互相窃取
+        iGrain = std::max(1, iCount / (getConcurrency() * 4));
+    }
+    int iChunks = (iCount + iGrain - 1) / iGrain;
+    std::vector<JobHandle> jobs;
+    jobs.reserve(iChunks - 1);
+    for (int c = 1; c < iChunks; c++)
+    {
+        int iBegin = c * iGrain;
+        int iEnd = std::min(iBegin + iGrain, iCount);
+        jobs.push_back(submit([&func, iBegin, iEnd]
+                              { func(iBegin, iEnd); }));
+    }
+    // 第一段由当前线程执行
+    func(0, std::min(iGrain, iCount));
+    wait(jobs);
+}
+
+void JobSystem::parallelFor2D(int iWidth, int iHeight, int iTileWidth, int iTileHeight, const std::function<void(int, int, int, int)> &func)
+{
+    if (iWidth <= 0 || iHeight <= 0)
+    {
+        return;
+    }
+    iTileWidth = std::max(iTileWidth, 1);
+    iTileHeight = std::max(iTileHeight, 1);
+    int iTilesX = (iWidth + iTileWidth - 1) / iTileWidth;
+    int iTilesY = (iHeight + iTileHeight - 1) / iTileHeight;
+    parallelFor(iTilesX * iTilesY, 1, [&](int iBegin, int iEnd)
+                {
+        for (int t = iBegin; t < iEnd; t++)
+        {
+            int x0 = (t % iTilesX) * iTileWidth;
+            int y0 = (t / iTilesX) * iTileHeight;
+            func(x0, y0, std::min(x0 + iTileWidth, iWidth), std::min(y0 + iTileHeight, iHeight));
+        } });
+}
+
+int JobSystem::runMainThreadJobs(double fBudgetMs)
+{
+    if (!isMainThread())
+    {
+        return 0;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int iCount = 0;
+    for (;;)
+    {
+        if (fBudgetMs >= 0.0 && iCount > 0)
+        {
+            double fElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (fElapsed >= fBudgetMs)
+            {
+                break;
+            }
+        }
+        JobHandle job = takeMainJob();
+        if (!job)
+        {
+            break;
+        }
+        job->func();
+        finish(job);
+        iCount++;
+    }
+    return iCount;
+}
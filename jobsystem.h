@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------
+// 工作窃取的任务调度器
+// 每个工作线程有自己的任务队列，从队尾取自己提交的任务，空闲时从其他线程的队首窃取；
+// 任务可以依赖其他任务，所有依赖完成后才进入队列。
+// 需要在 GL 线程上执行的任务提交到主线程队列，由帧循环调用 runMainThreadJobs 执行
+//----------------------------------------------------------------------
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+class JobSystem
+{
+public:
+    // iWorkers 为工作线程数，0 表示核心数 - 1（调用线程在等待时也会执行任务）
+    explicit JobSystem(int iWorkers = 0);
+    ~JobSystem();
+
+    // 全局实例，在主线程上第一次调用时创建
+    static JobSystem &instance();
+
+    // 工作线程数 + 调用线程
+    int getConcurrency() const { return (int)workers.size() + 1; }
+
+    //----------------------------------------------------------------------
+    // 提交任务，deps 中的任务全部完成后才会执行
+    //----------------------------------------------------------------------
+    JobHandle submit(std::function<void()> func, const std::vector<JobHandle> &deps = std::vector<JobHandle>());
+
+    // 提交只能在主线程（GL 线程）执行的任务
+    JobHandle submitMain(std::function<void()> func, const std::vector<JobHandle> &deps = std::vector<JobHandle>());
+
+    static bool isDone(const JobHandle &job);
+
+    //----------------------------------------------------------------------
+    // 等待任务完成，等待期间当前线程继续执行其他任务（在主线程上也执行主线程任务），
+    // 因此可以在任务内部等待子任务而不会死锁
+    //----------------------------------------------------------------------
+    void wait(const JobHandle &job);
+    void wait(const std::vector<JobHandle> &jobs);
+
+    //----------------------------------------------------------------------
+    // 把 [0, iCount) 按 iGrain 分段并行执行 func(iBegin, iEnd)，返回时全部完成
+    // iGrain <= 0 时按并发数自动分段
+    //----------------------------------------------------------------------
+    void parallelFor(int iCount, int iGrain, const std::function<void(int, int)> &func);
+
+    //----------------------------------------------------------------------
+    // 把 iWidth x iHeight 的二维范围按 iTileWidth x iTileHeight 分块并行执行 func(x0, y0, x1, y1)，返回时全部完成
+    //----------------------------------------------------------------------
+    void parallelFor2D(int iWidth, int iHeight, int iTileWidth, int iTileHeight, const std::function<void(int, int, int, int)> &func);
+
+    //----------------------------------------------------------------------
+    // 在主线程上执行主线程队列中的任务
+    // fBudgetMs: 本次最多花费的时间（毫秒），< 0 表示执行完所有已就绪的任务
+    // 返回执行的任务数
+    //----------------------------------------------------------------------
+    int runMainThreadJobs(double fBudgetMs = -1.0);
+
+    bool isMainThread() const { return std::this_thread::get_id() == mainThread; }
+
+private:
+    JobSystem(const JobSystem &);
+    JobSystem &operator=(const JobSystem &);
+
+    // 工作线程的任务队列，队尾由所有者使用，队首被其他线程窃取
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    void schedule(const JobHandle &job);
+    void finish(const JobHandle &job);
+    bool runOne(int iQueue);
+    JobHandle takeJob(int iQueue);
+    JobHandle takeMainJob();
+    void workerLoop(int iQueue);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // 每个工作线程一个，最后一个给外部线程提交的任务
+    WorkQueue mainQueue;
+    std::thread::id mainThread;
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> iQueued; // 所有工作队列中的任务数
+    bool bQuit;
+};
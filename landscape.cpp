@@ -0,0 +1,2035 @@
+#include "landscape.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// 交给上传线程时每个请求包含的补丁数
+#define LAND_UPLOAD_BATCH 64
+
+// 在 GL 线程上分批上传时每个主线程任务的时间片（毫秒），帧循环按自己的预算执行若干个时间片
+#define LAND_UPLOAD_SLICE_MS 1.0
+
+// 每帧等级选择时每个任务处理的可见补丁数，可见补丁少于此数时在当前线程完成
+#define LAND_LOD_GRAIN 256
+
+// 顶点着色器
+// 顶点只携带高度，XY 由 gl_VertexID 还原：批量绘制时 gl_VertexID 已包含 basevertex（补丁编号 * 每补丁顶点数），
+// 逐补丁绘制时由 uVertexOffset 补上。
+// 开启几何形变时，在当前等级消失的顶点按补丁的形变系数向下一等级的插值高度 aMorphHeight 混合
+static const char *vertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in float aHeight;
+layout(location = 1) in float aMorphHeight;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform int uPatchSize;
+uniform int uPatchesPerSide;
+uniform int uVertexOffset;
+uniform float uHeightScale;
+uniform float uHeightBias;
+uniform int uMaxLOD;
+uniform int uGeomorph;
+uniform samplerBuffer uPatchData;
+
+void main()
+{
+    int id = gl_VertexID + uVertexOffset;
+    int vertsPerPatch = uPatchSize * uPatchSize;
+    int patchIndex = id / vertsPerPatch;
+    int local = id - patchIndex * vertsPerPatch;
+    int i = local % uPatchSize;
+    int j = local / uPatchSize;
+    vec2 origin = vec2(patchIndex % uPatchesPerSide, patchIndex / uPatchesPerSide) * float(uPatchSize - 1);
+    vec2 xy = origin + vec2(i, j);
+    float h = aHeight;
+    if (uGeomorph != 0)
+    {
+        // 顶点所属的最粗等级
+        int level = 0;
+        while (level < uMaxLOD && ((i | j) & (1 << level)) == 0)
+            level++;
+        vec4 patchData = texelFetch(uPatchData, patchIndex * 2);
+        if (level == int(patchData.x))
+        {
+            // 边上的顶点使用与相邻补丁一致的形变系数
+            vec4 edge = texelFetch(uPatchData, patchIndex * 2 + 1);
+            float morph = patchData.y;
+            if (i == 0)
+                morph = edge.x;
+            else if (j == uPatchSize - 1)
+                morph = edge.y;
+            else if (i == uPatchSize - 1)
+                morph = edge.z;
+            else if (j == 0)
+                morph = edge.w;
+            h = mix(aHeight, aMorphHeight, morph);
+        }
+    }
+    float z = h * uHeightScale + uHeightBias;
+    gl_Position = projection * view * model * vec4(xy, z, 1.0);
+}
+)";
+
+// 实例化绘制的顶点着色器
+// 顶点只携带补丁内坐标，所有补丁共用；实例属性给出补丁坐标与等级，高度从 R16 高度纹理读取。
+// 开启几何形变时，形变目标高度按 InterpolateFanHeight 的三角剖分在下一等级的网格上插值得到
+static const char *instancedVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 aGrid;
+layout(location = 2) in ivec3 aInstance;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform int uPatchSize;
+uniform int uPatchesPerSide;
+uniform float uHeightScale;
+uniform float uHeightBias;
+uniform int uMaxLOD;
+uniform int uGeomorph;
+uniform samplerBuffer uPatchData;
+uniform sampler2D uHeightMap;
+
+float fetchHeight(ivec2 p)
+{
+    return texelFetch(uHeightMap, p, 0).r;
+}
+
+// 补丁内 (i, j) 处在顶点间距为 step 的三角扇网格上的插值高度，与 InterpolateFanHeight 相同
+float fanHeight(ivec2 origin, int i, int j, int step)
+{
+    int ci = min(i / step * step, uPatchSize - 1 - step);
+    int cj = min(j / step * step, uPatchSize - 1 - step);
+    float u = float(i - ci) / float(step);
+    float v = float(j - cj) / float(step);
+    float h00 = fetchHeight(origin + ivec2(ci, cj));
+    float h10 = fetchHeight(origin + ivec2(ci + step, cj));
+    float h01 = fetchHeight(origin + ivec2(ci, cj + step));
+    float h11 = fetchHeight(origin + ivec2(ci + step, cj + step));
+    bool bLeft = (ci / step) % 2 == 0;
+    bool bBottom = (cj / step) % 2 == 0;
+    if (bLeft == bBottom)
+    {
+        if (u >= v)
+            return h00 + u * (h10 - h00) + v * (h11 - h10);
+        return h00 + v * (h01 - h00) + u * (h11 - h01);
+    }
+    if (u + v <= 1.0)
+        return h00 + u * (h10 - h00) + v * (h01 - h00);
+    return h11 + (1.0 - u) * (h01 - h11) + (1.0 - v) * (h10 - h11);
+}
+
+void main()
+{
+    int i = int(aGrid.x);
+    int j = int(aGrid.y);
+    ivec2 origin = aInstance.xy * (uPatchSize - 1);
+    float h = fetchHeight(origin + ivec2(i, j));
+    if (uGeomorph != 0)
+    {
+        // 顶点所属的最粗等级
+        int level = 0;
+        while (level < uMaxLOD && ((i | j) & (1 << level)) == 0)
+            level++;
+        if (level == aInstance.z && level < uMaxLOD)
+        {
+            // 边上的顶点使用与相邻补丁一致的形变系数
+            int patchIndex = aInstance.y * uPatchesPerSide + aInstance.x;
+            vec4 edge = texelFetch(uPatchData, patchIndex * 2 + 1);
+            float morph = texelFetch(uPatchData, patchIndex * 2).y;
+            if (i == 0)
+                morph = edge.x;
+            else if (j == uPatchSize - 1)
+                morph = edge.y;
+            else if (i == uPatchSize - 1)
+                morph = edge.z;
+            else if (j == 0)
+                morph = edge.w;
+            h = mix(h, fanHeight(origin, i, j, 2 << level), morph);
+        }
+    }
+    float z = h * uHeightScale + uHeightBias;
+    gl_Position = projection * view * model * vec4(vec2(origin) + aGrid, z, 1.0);
+}
+)";
+
+// 片段着色器
+static const char *fragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(1.0, 0.0, 1.0, 1.0); // 白色
+}
+)";
+
+//----------------------------------------------------------------------
+// 以三角形列表的形式追加一个三角扇（中心点 + 周围 8 个点，最多 8 个三角形）
+// indices: 输出的索引
+// iPatchSize: 补丁每边的顶点数
+// cx, cy: 扇形中心点在补丁内的坐标
+// step: 当前等级下相邻顶点的间距
+// iSkipMask: LandStitchMask 组合，置位一侧跳过边中点，与粗一级的相邻补丁对齐
+//----------------------------------------------------------------------
+static void AppendFan(std::vector<unsigned short> &indices, int iPatchSize, int cx, int cy, int step, int iSkipMask = 0)
+{
+    // 与原先 GL_TRIANGLE_FAN 的顶点顺序一致：中心，然后从左上角逆时针绕一圈回到左上角
+    // 第三列为该点作为边中点时对应的接缝掩码
+    const int ring[9][3] = {
+        {-1, 1, 0}, {-1, 0, LAND_STITCH_LEFT}, {-1, -1, 0}, {0, -1, LAND_STITCH_DOWN}, {1, -1, 0}, {1, 0, LAND_STITCH_RIGHT}, {1, 1, 0}, {0, 1, LAND_STITCH_UP}, {-1, 1, 0}};
+    unsigned short center = (unsigned short)(cy * iPatchSize + cx);
+    int prev = 0;
+    for (int k = 1; k < 9; k++)
+    {
+        if (ring[k][2] & iSkipMask)
+        {
+            continue;
+        }
+        indices.push_back(center);
+        indices.push_back((unsigned short)((cy + ring[prev][1] * step) * iPatchSize + cx + ring[prev][0] * step));
+        indices.push_back((unsigned short)((cy + ring[k][1] * step) * iPatchSize + cx + ring[k][0] * step));
+        prev = k;
+    }
+}
+
+//----------------------------------------------------------------------
+// 求补丁内 (i, j) 处在某个等级的三角扇网格上的插值高度
+// heights: 补丁的全分辨率高度
+// step: 该等级的顶点间距
+// 每个 step x step 的格子被扇形中心与格子角点的连线分成两个三角形
+//----------------------------------------------------------------------
+static float InterpolateFanHeight(const float *heights, int iPatchSize, int i, int j, int step)
+{
+    // 所在格子的左下角，最后一行/列归入前一个格子
+    int ci = std::min(i / step * step, iPatchSize - 1 - step);
+    int cj = std::min(j / step * step, iPatchSize - 1 - step);
+    float u = (float)(i - ci) / step;
+    float v = (float)(j - cj) / step;
+
+    float h00 = heights[cj * iPatchSize + ci];
+    float h10 = heights[cj * iPatchSize + ci + step];
+    float h01 = heights[(cj + step) * iPatchSize + ci];
+    float h11 = heights[(cj + step) * iPatchSize + ci + step];
+
+    // 扇形中心位于 step 的奇数倍处；格子在中心的左下或右上时对角线为 (0,0)-(1,1)，否则为 (1,0)-(0,1)
+    bool bLeft = (ci / step) % 2 == 0;
+    bool bBottom = (cj / step) % 2 == 0;
+    if (bLeft == bBottom)
+    {
+        if (u >= v)
+        {
+            return h00 + u * (h10 - h00) + v * (h11 - h10);
+        }
+        return h00 + v * (h01 - h00) + u * (h11 - h01);
+    }
+    if (u + v <= 1.0f)
+    {
+        return h00 + u * (h10 - h00) + v * (h01 - h00);
+    }
+    return h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+}
+
+//----------------------------------------------------------------------
+// 预计算补丁每个等级相对全分辨率数据的最大垂直误差（几何误差）
+// errors: 输出 iMaxLOD + 1 个误差，等级越高误差单调不减
+//----------------------------------------------------------------------
+static void ComputePatchErrors(const float *heights, int iPatchSize, int iMaxLOD, float *errors)
+{
+    errors[0] = 0.0f;
+    for (int lod = 1; lod <= iMaxLOD; lod++)
+    {
+        int step = 1 << lod;
+        float fError = 0.0f;
+        for (int j = 0; j < iPatchSize; j++)
+        {
+            for (int i = 0; i < iPatchSize; i++)
+            {
+                // 该等级上存在的顶点没有误差
+                if (i % step == 0 && j % step == 0)
+                {
+                    continue;
+                }
+                fError = std::max(fError, std::fabs(heights[j * iPatchSize + i] - InterpolateFanHeight(heights, iPatchSize, i, j, step)));
+            }
+        }
+        errors[lod] = std::max(fError, errors[lod - 1]);
+    }
+}
+
+//----------------------------------------------------------------------
+// 计算补丁内每个顶点的形变目标高度
+// 顶点在等级 l 存在、在 l + 1 消失时，目标为它在 l + 1 网格上的插值高度；最粗等级仍存在的顶点目标为自身高度
+// morphTargets: 输出 iPatchSize * iPatchSize 个高度
+//----------------------------------------------------------------------
+static void ComputeMorphTargets(const float *heights, int iPatchSize, int iMaxLOD, float *morphTargets)
+{
+    for (int j = 0; j < iPatchSize; j++)
+    {
+        for (int i = 0; i < iPatchSize; i++)
+        {
+            // 顶点所属的最粗等级：i、j 都是 2^level 的倍数
+            int level = 0;
+            while (level < iMaxLOD && ((i | j) & (1 << level)) == 0)
+            {
+                level++;
+            }
+            if (level >= iMaxLOD)
+            {
+                morphTargets[j * iPatchSize + i] = heights[j * iPatchSize + i];
+                continue;
+            }
+            morphTargets[j * iPatchSize + i] = InterpolateFanHeight(heights, iPatchSize, i, j, 2 << level);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 包围盒是否贴着某个裁剪平面：Frustum::testAABB 判断可见用的 p-vertex 到平面的距离
+// 不超过各项绝对值之和的 fEpsilon 倍，舍入不同时 CPU 与 GPU 可能得出不同的可见性
+//----------------------------------------------------------------------
+static bool IsNearFrustumPlane(const Frustum &frustum, const glm::vec3 &vMin, const glm::vec3 &vMax, float fEpsilon)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const glm::vec4 &p = frustum.planes[i];
+        glm::vec3 vPositive(p.x >= 0 ? vMax.x : vMin.x, p.y >= 0 ? vMax.y : vMin.y, p.z >= 0 ? vMax.z : vMin.z);
+        float f = p.x * vPositive.x + p.y * vPositive.y + p.z * vPositive.z + p.w;
+        float fMagnitude = std::fabs(p.x * vPositive.x) + std::fabs(p.y * vPositive.y) + std::fabs(p.z * vPositive.z) + std::fabs(p.w);
+        if (std::fabs(f) <= fEpsilon * fMagnitude)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+LandScapeMap::LandScapeMap(int m_iSize, int iPatchSize, LandRenderMode eRenderMode, LandVertexFormat eVertexFormat)
+{
+    this->eRenderMode = eRenderMode;
+    this->eVertexFormat = eVertexFormat;
+    iComponentSize = sizeof(unsigned short);
+    iVertexStride = sizeof(unsigned short);
+    fHeightScale = 1.0f;
+    fHeightBias = 0.0f;
+    iStoreSize = 0;
+    fStoreScale = 1.0f;
+    fStoreBias = 0.0f;
+    bKeepPatchVertices = false;
+    fPixelError = 2.0f;
+    bGeomorph = false;
+    fMorphRange = 0.3f;
+    uiPatchDataTBO = 0;
+    uiPatchDataTex = 0;
+    uiTexBufferAlignment = 1;
+    bMorphRingUsed = false;
+    bGpuCulling = false;
+    iPatchSizeLoc = iPatchesPerSideLoc = iVertexOffsetLoc = iHeightScaleLoc = iHeightBiasLoc = -1;
+    iMaxLODLoc = iGeomorphLoc = iPatchDataLoc = iHeightMapLoc = -1;
+    iModelLoc = iViewLoc = iProjectionLoc = -1;
+    uiIndexEBO = 0;
+    uiBatchVAO = 0;
+    uiBatchVBO = 0;
+    uiGridVBO = 0;
+    uiInstanceVAO = 0;
+    uiHeightTex = 0;
+    bOwnsHeightTex = false;
+    iLoadStage = LAND_LOAD_IDLE;
+    fLoadProgress = 0.0f;
+    bCancelLoad = false;
+    pCacheVertices = nullptr;
+    iResidentPatches = 0;
+    pUploadThread = nullptr;
+    this->iPatchSize = iPatchSize;
+    this->m_iSize = m_iSize;
+    iNumPatchesPerSide = m_iSize / (iPatchSize - 1);
+    LandPatches = new LandPatch[iNumPatchesPerSide * iNumPatchesPerSide];
+    setHeightMapFile("heightmap.tif");
+
+    int iLOD = 0;
+    int iDivisor = iPatchSize - 1;
+    while (iDivisor > 2)
+    {
+        iDivisor = iDivisor >> 1;
+        iLOD++;
+    }
+    iMaxLOD = iLOD;
+}
+
+//----------------------------------------------------------------------
+// 生成所有等级的索引，放入同一个索引缓冲区
+//----------------------------------------------------------------------
+bool LandScapeMap::initIndices()
+{
+    // 一个补丁最多 65536 个顶点，因此使用 16 位索引
+    if (iPatchSize * iPatchSize > 65536)
+    {
+        std::cerr << "Patch size too large for 16-bit indices: " << iPatchSize << std::endl;
+        return false;
+    }
+    // 每个等级预先生成 16 种接缝版本，所有补丁共用
+    LandPatchIndices = new LandPatchIndex[(iMaxLOD + 1) * LAND_STITCH_VARIANTS];
+    std::vector<unsigned short> indices;
+    for (int32_t c_lod = 0; c_lod <= iMaxLOD; c_lod++)
+    {
+        // 当前等级每边的三角扇数量以及顶点间距
+        int fans_per_side = (iPatchSize - 1) >> (c_lod + 1);
+        int step = 1 << c_lod;
+
+        for (int32_t mask = 0; mask < LAND_STITCH_VARIANTS; mask++)
+        {
+            LandPatchIndex &variant = LandPatchIndices[c_lod * LAND_STITCH_VARIANTS + mask];
+            variant.indices_offset = (unsigned int)(indices.size() * sizeof(unsigned short));
+            // 构建顶点索引，只有补丁边上的扇形需要跳过边中点
+            for (int32_t j = 0; j < fans_per_side; j++)
+            {
+                for (int32_t i = 0; i < fans_per_side; i++)
+                {
+                    int iSkip = 0;
+                    iSkip |= i == 0 ? (mask & LAND_STITCH_LEFT) : 0;
+                    iSkip |= i == fans_per_side - 1 ? (mask & LAND_STITCH_RIGHT) : 0;
+                    iSkip |= j == 0 ? (mask & LAND_STITCH_DOWN) : 0;
+                    iSkip |= j == fans_per_side - 1 ? (mask & LAND_STITCH_UP) : 0;
+                    AppendFan(indices, iPatchSize, i * (step * 2) + step, j * (step * 2) + step, step, iSkip);
+                }
+            }
+            variant.indices_count = (int)(indices.size() - variant.indices_offset / sizeof(unsigned short));
+            variant.iLOD = c_lod;
+        }
+    }
+
+    // 生成索引缓冲区
+    glGenBuffers(1, &uiIndexEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 递归构建覆盖补丁范围 [x0, x1) x [y0, y1) 的四叉树节点，返回节点编号
+//----------------------------------------------------------------------
+int LandScapeMap::buildQuadNode(int x0, int y0, int x1, int y1)
+{
+    int node = (int)QuadTree.size();
+    QuadTree.push_back(LandQuadNode());
+    QuadTree[node].x0 = x0;
+    QuadTree[node].y0 = y0;
+    QuadTree[node].x1 = x1;
+    QuadTree[node].y1 = y1;
+    for (int i = 0; i < 4; i++)
+    {
+        QuadTree[node].children[i] = -1;
+    }
+
+    glm::vec3 vMin, vMax;
+    if (x1 - x0 == 1 && y1 - y0 == 1)
+    {
+        // 叶子节点即单个补丁
+        const LandPatch &patch = LandPatches[y0 * iNumPatchesPerSide + x0];
+        vMin = glm::vec3(patch.imin_x, patch.imin_y, patch.fMinHeight);
+        vMax = glm::vec3(patch.imax_x, patch.imax_y, patch.fMaxHeight);
+    }
+    else
+    {
+        // 按中点拆分，某一方向只剩一个补丁时只拆另一个方向
+        int mx = x1 - x0 > 1 ? (x0 + x1) / 2 : x1;
+        int my = y1 - y0 > 1 ? (y0 + y1) / 2 : y1;
+        int ranges[4][4] = {{x0, y0, mx, my}, {mx, y0, x1, my}, {x0, my, mx, y1}, {mx, my, x1, y1}};
+        vMin = glm::vec3(std::numeric_limits<float>::max());
+        vMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (int i = 0; i < 4; i++)
+        {
+            if (ranges[i][0] >= ranges[i][2] || ranges[i][1] >= ranges[i][3])
+            {
+                continue;
+            }
+            int child = buildQuadNode(ranges[i][0], ranges[i][1], ranges[i][2], ranges[i][3]);
+            QuadTree[node].children[i] = child;
+            vMin = glm::min(vMin, QuadTree[child].vMin);
+            vMax = glm::max(vMax, QuadTree[child].vMax);
+        }
+    }
+    QuadTree[node].vMin = vMin;
+    QuadTree[node].vMax = vMax;
+    return node;
+}
+
+//----------------------------------------------------------------------
+// 用视锥体遍历四叉树，收集可见补丁；bInside 为 true 时父节点已完全在视锥体内，不再检测
+//----------------------------------------------------------------------
+void LandScapeMap::cullQuadNode(int node, const Frustum &frustum, bool bInside)
+{
+    const LandQuadNode &quad = QuadTree[node];
+    if (!bInside)
+    {
+        FRUSTUM_RESULT result = frustum.testAABB(quad.vMin, quad.vMax);
+        if (result == FRUSTUM_OUTSIDE)
+        {
+            return;
+        }
+        bInside = result == FRUSTUM_INSIDE;
+    }
+
+    if (bInside || (quad.children[0] < 0 && quad.children[1] < 0 && quad.children[2] < 0 && quad.children[3] < 0))
+    {
+        // 整个子树可见，直接收集其中的补丁
+        for (int y = quad.y0; y < quad.y1; y++)
+        {
+            for (int x = quad.x0; x < quad.x1; x++)
+            {
+                VisiblePatches.push_back(y * iNumPatchesPerSide + x);
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (quad.children[i] >= 0)
+        {
+            cullQuadNode(quad.children[i], frustum, false);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 设置当前绑定 VBO 的顶点属性，属性 0 为单个高度分量
+//----------------------------------------------------------------------
+void LandScapeMap::setupVertexAttrib()
+{
+    // 属性 1 为形变目标高度，与高度交错存放
+    int iAttribs = bGeomorph ? 2 : 1;
+    for (int a = 0; a < iAttribs; a++)
+    {
+        if (eVertexFormat == LAND_VERTEX_HEIGHT_U16)
+        {
+            // 不做归一化，着色器中得到 0~65535 的浮点值，再乘 uHeightScale
+            glVertexAttribPointer(a, 1, GL_UNSIGNED_SHORT, GL_FALSE, iVertexStride, (void *)(size_t)(a * iComponentSize));
+        }
+        else
+        {
+            glVertexAttribPointer(a, 1, GL_FLOAT, GL_FALSE, iVertexStride, (void *)(size_t)(a * iComponentSize));
+        }
+        glEnableVertexAttribArray(a);
+    }
+}
+
+//----------------------------------------------------------------------
+// 按顶点格式写入一个高度分量
+//----------------------------------------------------------------------
+void LandScapeMap::writeHeight(unsigned char *dst, float z) const
+{
+    if (eVertexFormat == LAND_VERTEX_HEIGHT_U16)
+    {
+        unsigned short q = (unsigned short)std::min(std::max((z - fHeightBias) / fHeightScale + 0.5f, 0.0f), 65535.0f);
+        memcpy(dst, &q, sizeof(q));
+    }
+    else
+    {
+        memcpy(dst, &z, sizeof(z));
+    }
+}
+
+//----------------------------------------------------------------------
+// 根据顶点格式确定每个顶点的布局与高度换算参数，需要先算好共享量化参数
+//----------------------------------------------------------------------
+void LandScapeMap::setupVertexFormat()
+{
+    if (eVertexFormat == LAND_VERTEX_HEIGHT_U16)
+    {
+        // 顶点直接使用共享高度的量化值
+        iComponentSize = sizeof(unsigned short);
+        fHeightScale = fStoreScale;
+        fHeightBias = fStoreBias;
+    }
+    else
+    {
+        iComponentSize = sizeof(float);
+        fHeightScale = 1.0f;
+        fHeightBias = 0.0f;
+    }
+    iVertexStride = iComponentSize * (bGeomorph ? 2 : 1);
+}
+
+//----------------------------------------------------------------------
+// 填写补丁的位置与高度范围，顶点尚未上传
+//----------------------------------------------------------------------
+void LandScapeMap::initPatch(int iPatch, float fMinHeight, float fMaxHeight)
+{
+    LandPatch &patch = LandPatches[iPatch];
+    patch.iLOD = iMaxLOD;
+    patch.fDistance = 0.0f;
+    // 补丁左下角在高度图中的坐标
+    int half = iPatchSize / 2;
+    int ox = (iPatch % iNumPatchesPerSide) * (iPatchSize - 1);
+    int oy = (iPatch / iNumPatchesPerSide) * (iPatchSize - 1);
+    patch.ix = (float)(ox + half);
+    patch.iy = (float)(oy + half);
+    patch.imin_x = (float)ox;
+    patch.imin_y = (float)oy;
+    patch.imax_x = (float)(ox + iPatchSize - 1);
+    patch.imax_y = (float)(oy + iPatchSize - 1);
+    patch.fMinHeight = fMinHeight;
+    patch.fMaxHeight = fMaxHeight;
+    patch.VAO = 0;
+    patch.vertices = nullptr;
+}
+
+//----------------------------------------------------------------------
+// 缓存中从 offset 开始、长度为 length 字节的一段是否完整落在大小为 fileSize 的文件内
+//----------------------------------------------------------------------
+bool LandScapeMap::isCacheSectionValid(uint64_t offset, uint64_t length, uint64_t fileSize)
+{
+    return offset <= fileSize && length <= fileSize - offset;
+}
+
+//----------------------------------------------------------------------
+// 映射补丁缓存，读取共享高度、几何误差，填写补丁的 CPU 数据并构建四叉树，不调用 GL，可以在工作线程上执行
+// 缓存保持映射，顶点由 uploadPatches 在 GL 线程上分批上传
+// 缓存不存在、源高度图的大小或修改时间变化、或者地形参数不一致时返回 false
+//----------------------------------------------------------------------
+bool LandScapeMap::readPatchCache()
+{
+    MappedFile &cache = PatchCache;
+    if (!cache.open(strCacheFile.c_str()))
+    {
+        return false;
+    }
+    if (cache.size() < sizeof(PatchCacheHeader))
+    {
+        // 缓存是成员，不关闭会一直映射，之后烘焙时无法替换文件
+        cache.close();
+        return false;
+    }
+    PatchCacheHeader header;
+    memcpy(&header, cache.data(), sizeof(header));
+
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!GetFileStamp(strHeightMapFile.c_str(), sourceSize, sourceTime))
+    {
+        cache.close();
+        return false;
+    }
+    if (memcmp(header.magic, PATCH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != PATCH_CACHE_VERSION || header.headerSize != sizeof(header) ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime || header.fileSize != cache.size() ||
+        header.iPatchSize != iPatchSize || header.iNumPatchesPerSide != iNumPatchesPerSide || header.iMaxLOD != iMaxLOD ||
+        header.iVertexFormat != (int32_t)eVertexFormat || header.iGeomorph != (bGeomorph ? 1 : 0) ||
+        (header.verticesOffset == 0 && eRenderMode != LAND_RENDER_INSTANCED))
+    {
+        cache.close();
+        return false;
+    }
+
+    fStoreScale = header.fStoreScale;
+    fStoreBias = header.fStoreBias;
+    iStoreSize = header.iStoreSize;
+    setupVertexFormat();
+
+    // 文件大小一致不代表各段的偏移可信，逐段检查是否落在文件内，损坏的缓存按失效处理
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    int iVertsPerPatch = iPatchSize * iPatchSize;
+    size_t patchBytes = (size_t)iVertexStride * iVertsPerPatch;
+    if (header.iVertexStride != iVertexStride || header.iStoreSize != iNumPatchesPerSide * (iPatchSize - 1) + 1 ||
+        !isCacheSectionValid(header.boundsOffset, sizeof(float) * 2 * (uint64_t)iNumPatches, cache.size()) ||
+        !isCacheSectionValid(header.errorsOffset, sizeof(float) * (uint64_t)(iMaxLOD + 1) * iNumPatches, cache.size()) ||
+        !isCacheSectionValid(header.storeOffset, sizeof(unsigned short) * (uint64_t)iStoreSize * iStoreSize, cache.size()) ||
+        (header.verticesOffset != 0 && !isCacheSectionValid(header.verticesOffset, (uint64_t)patchBytes * iNumPatches, cache.size())))
+    {
+        std::cerr << "Corrupt patch cache: " << strCacheFile << std::endl;
+        cache.close();
+        return false;
+    }
+    const float *bounds = (const float *)(cache.data() + header.boundsOffset);
+    const float *errors = (const float *)(cache.data() + header.errorsOffset);
+    const unsigned short *store = (const unsigned short *)(cache.data() + header.storeOffset);
+    // 实例化绘制烘焙的缓存没有顶点段，实例化绘制也不需要读取
+    pCacheVertices = eRenderMode != LAND_RENDER_INSTANCED ? cache.data() + header.verticesOffset : nullptr;
+
+    HeightStore.assign(store, store + (size_t)iStoreSize * iStoreSize);
+    PatchErrors.assign(errors, errors + (size_t)iNumPatches * (iMaxLOD + 1));
+    initPatches(bounds, pCacheVertices);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 由每个补丁的高度范围 bounds（每个补丁 2 个 float）填写全部补丁并构建四叉树
+// vertices 为全部补丁的顶点，保留 CPU 副本时从中复制，可以为空
+//----------------------------------------------------------------------
+void LandScapeMap::initPatches(const float *bounds, const unsigned char *vertices)
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    size_t patchBytes = (size_t)iVertexStride * iPatchSize * iPatchSize;
+    // 补丁之间互不依赖，并行填写
+    JobSystem::instance().parallelFor(iNumPatches, 0, [&](int iBegin, int iEnd)
+                                      {
+        for (int iPatch = iBegin; iPatch < iEnd; iPatch++)
+        {
+            LandPatch &patch = LandPatches[iPatch];
+            initPatch(iPatch, bounds[iPatch * 2], bounds[iPatch * 2 + 1]);
+            if (bKeepPatchVertices && vertices != nullptr)
+            {
+                patch.vertices = new unsigned char[patchBytes];
+                memcpy(patch.vertices, vertices + patchBytes * iPatch, patchBytes);
+            }
+        } });
+
+    // 构建补丁四叉树
+    QuadTree.clear();
+    QuadTree.reserve(iNumPatches * 2);
+    buildQuadNode(0, 0, iNumPatchesPerSide, iNumPatchesPerSide);
+}
+
+//----------------------------------------------------------------------
+// 在 GL 线程上创建批量绘制的 VBO、VAO 和形变数据的纹理缓冲区
+// pVertices: 全部补丁的顶点，为 nullptr 时只分配，之后分批写入
+//----------------------------------------------------------------------
+void LandScapeMap::createPatchBuffers(const void *pVertices)
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    size_t patchBytes = (size_t)iVertexStride * iPatchSize * iPatchSize;
+    if (eRenderMode == LAND_RENDER_BATCHED && uiBatchVBO == 0)
+    {
+        // 缓存中的顶点段与共享 VBO 的布局一致
+        glGenVertexArrays(1, &uiBatchVAO);
+        glGenBuffers(1, &uiBatchVBO);
+
+        glBindVertexArray(uiBatchVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, uiBatchVBO);
+        glBufferData(GL_ARRAY_BUFFER, patchBytes * iNumPatches, pVertices, GL_STATIC_DRAW);
+
+        setupVertexAttrib();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexEBO);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (eRenderMode == LAND_RENDER_INSTANCED && uiGridVBO == 0)
+    {
+        createInstanceBuffers();
+    }
+    if (bGeomorph && uiPatchDataTBO == 0)
+    {
+        // 每个补丁的等级与形变系数放在纹理缓冲区中，着色器由补丁编号读取
+        PatchMorphData.assign((size_t)iNumPatches * 2, glm::vec4(0.0f));
+        glGenBuffers(1, &uiPatchDataTBO);
+        glBindBuffer(GL_TEXTURE_BUFFER, uiPatchDataTBO);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * PatchMorphData.size(), PatchMorphData.data(), GL_DYNAMIC_DRAW);
+        glGenTextures(1, &uiPatchDataTex);
+        glBindTexture(GL_TEXTURE_BUFFER, uiPatchDataTex);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, uiPatchDataTBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // 支持纹理缓冲区子范围时，每帧的形变数据改为写入三段的环形缓冲区
+        if (GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_texture_buffer_range)
+        {
+            GLint iAlignment = 1;
+            glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &iAlignment);
+            uiTexBufferAlignment = (size_t)std::max(iAlignment, 1);
+            MorphRing.init(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * PatchMorphData.size() + uiTexBufferAlignment, 3);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 创建实例化绘制的共享网格与 VAO，并分配高度纹理（实例环形缓冲区由 checkRenderMode 创建），纹理内容之后按补丁行写入
+//----------------------------------------------------------------------
+void LandScapeMap::createInstanceBuffers()
+{
+    // 补丁内坐标，顶点编号与共享索引缓冲区一致：j * iPatchSize + i
+    std::vector<unsigned char> grid((size_t)iPatchSize * iPatchSize * 2);
+    for (int j = 0; j < iPatchSize; j++)
+    {
+        for (int i = 0; i < iPatchSize; i++)
+        {
+            grid[((size_t)j * iPatchSize + i) * 2] = (unsigned char)i;
+            grid[((size_t)j * iPatchSize + i) * 2 + 1] = (unsigned char)j;
+        }
+    }
+    glGenVertexArrays(1, &uiInstanceVAO);
+    glGenBuffers(1, &uiGridVBO);
+    glBindVertexArray(uiInstanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, uiGridVBO);
+    glBufferData(GL_ARRAY_BUFFER, grid.size(), grid.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, 2, (void *)0);
+    glEnableVertexAttribArray(0);
+    // 属性 2 为实例属性，指针在绘制每组实例时设置
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(2);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexEBO);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // 使用 GpuTerrain 的高度纹理时不另建纹理
+    if (uiHeightTex != 0)
+    {
+        return;
+    }
+    glGenTextures(1, &uiHeightTex);
+    glBindTexture(GL_TEXTURE_2D, uiHeightTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, iStoreSize, iStoreSize, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+    // 着色器只用 texelFetch 读取
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    bOwnsHeightTex = true;
+}
+
+//----------------------------------------------------------------------
+// 把补丁行 [iBeginRow, iEndRow) 用到的高度写入高度纹理，相邻补丁行共用的边界行只写一次
+// 高度纹理是共享对象，也可以在上传线程上调用
+//----------------------------------------------------------------------
+void LandScapeMap::uploadHeightRows(unsigned int uiTexture, int iBeginRow, int iEndRow) const
+{
+    int y0 = iBeginRow == 0 ? 0 : iBeginRow * (iPatchSize - 1) + 1;
+    int y1 = iEndRow * (iPatchSize - 1) + 1;
+    glBindTexture(GL_TEXTURE_2D, uiTexture);
+    // 每行 iStoreSize 个 16 位高度，行长不一定是 4 的倍数
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y0, iStoreSize, y1 - y0, GL_RED, GL_UNSIGNED_SHORT, &HeightStore[(size_t)y0 * iStoreSize]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//----------------------------------------------------------------------
+// 为一个补丁的 VBO 创建 VAO，VAO 不在上下文之间共享，只能在 GL 线程上创建
+//----------------------------------------------------------------------
+unsigned int LandScapeMap::createPatchVAO(unsigned int VBO)
+{
+    unsigned int VAO;
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    setupVertexAttrib();
+    // 共享索引缓冲区记录在 VAO 中，绘制时无需再绑定
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexEBO);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return VAO;
+}
+
+//----------------------------------------------------------------------
+// 全部补丁上传后释放缓存映射
+//----------------------------------------------------------------------
+void LandScapeMap::finishUpload()
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    if (eRenderMode == LAND_RENDER_BATCHED)
+    {
+        for (int iPatch = 0; iPatch < iNumPatches; iPatch++)
+        {
+            LandPatches[iPatch].VAO = uiBatchVAO;
+        }
+    }
+    fLoadProgress = 1.0f;
+    pCacheVertices = nullptr;
+    PatchCache.close();
+    std::vector<unsigned char>().swap(PatchVertices);
+    if (bGpuCulling)
+    {
+        initGpuCulling();
+    }
+    iLoadStage = LAND_LOAD_READY;
+}
+
+//----------------------------------------------------------------------
+// 把补丁包围盒、几何误差和接缝版本的索引范围交给 GpuCuller，失败时继续在 CPU 上裁剪
+//----------------------------------------------------------------------
+void LandScapeMap::initGpuCulling()
+{
+    if (eRenderMode != LAND_RENDER_BATCHED || !GpuPatchCuller::isSupported())
+    {
+        std::cerr << "GPU culling requires batched rendering and OpenGL 4.3, culling on the CPU" << std::endl;
+        bGpuCulling = false;
+        return;
+    }
+    if (!createGpuCuller())
+    {
+        bGpuCulling = false;
+    }
+}
+
+//----------------------------------------------------------------------
+// 创建 GpuCuller，只做等级选择时（自检）不要求批量绘制
+//----------------------------------------------------------------------
+bool LandScapeMap::createGpuCuller()
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    std::vector<glm::vec4> bounds((size_t)iNumPatches * 2);
+    for (int iPatch = 0; iPatch < iNumPatches; iPatch++)
+    {
+        const LandPatch &patch = LandPatches[iPatch];
+        bounds[(size_t)iPatch * 2] = glm::vec4((float)patch.imin_x, (float)patch.imin_y, patch.fMinHeight, 0.0f);
+        bounds[(size_t)iPatch * 2 + 1] = glm::vec4((float)patch.imax_x, (float)patch.imax_y, patch.fMaxHeight, 0.0f);
+    }
+    // 索引偏移换算成起始索引
+    std::vector<GLuint> variants((size_t)(iMaxLOD + 1) * LAND_STITCH_VARIANTS * 2);
+    for (int i = 0; i < (iMaxLOD + 1) * LAND_STITCH_VARIANTS; i++)
+    {
+        variants[(size_t)i * 2] = (GLuint)LandPatchIndices[i].indices_count;
+        variants[(size_t)i * 2 + 1] = (GLuint)(LandPatchIndices[i].indices_offset / sizeof(unsigned short));
+    }
+    return GpuCuller.init(iNumPatchesPerSide, iPatchSize * iPatchSize, iMaxLOD, bounds, PatchErrors, variants);
+}
+
+//----------------------------------------------------------------------
+// 在 GL 线程上按补丁编号顺序上传顶点，编号小于 iResidentPatches 的补丁可以绘制
+// fBudgetMs: 本次最多花费的时间（毫秒），至少上传一个补丁；< 0 表示全部上传
+// 全部上传后释放缓存映射，返回 true
+//----------------------------------------------------------------------
+bool LandScapeMap::uploadPatches(double fBudgetMs)
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    size_t patchBytes = (size_t)iVertexStride * iPatchSize * iPatchSize;
+    if (iResidentPatches == 0)
+    {
+        // 全部上传时直接用缓存初始化 VBO
+        createPatchBuffers(fBudgetMs < 0.0 ? pCacheVertices : nullptr);
+        if (fBudgetMs < 0.0 && eRenderMode == LAND_RENDER_BATCHED)
+        {
+            iResidentPatches = iNumPatches;
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (iResidentPatches < iNumPatches)
+    {
+        int iPatch = iResidentPatches;
+        if (eRenderMode == LAND_RENDER_INSTANCED)
+        {
+            // 实例化绘制没有顶点需要上传，一次写入一行补丁的高度
+            int iRow = iPatch / iNumPatchesPerSide;
+            uploadHeightRows(uiHeightTex, iRow, iRow + 1);
+            iResidentPatches = (iRow + 1) * iNumPatchesPerSide;
+            if (fBudgetMs >= 0.0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= fBudgetMs)
+            {
+                break;
+            }
+            continue;
+        }
+        const unsigned char *patchVertices = pCacheVertices + patchBytes * iPatch;
+        if (eRenderMode == LAND_RENDER_BATCHED)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, uiBatchVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, patchBytes * iPatch, patchBytes, patchVertices);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            LandPatches[iPatch].VAO = uiBatchVAO;
+        }
+        else
+        {
+            unsigned int VBO;
+            glGenBuffers(1, &VBO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, patchBytes, patchVertices, GL_STATIC_DRAW);
+            LandPatches[iPatch].VAO = createPatchVAO(VBO); // 保存 VAO
+        }
+        iResidentPatches++;
+        if (fBudgetMs >= 0.0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= fBudgetMs)
+        {
+            break;
+        }
+    }
+    fLoadProgress = (float)iResidentPatches / iNumPatches;
+    if (iResidentPatches < iNumPatches)
+    {
+        return false;
+    }
+    finishUpload();
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 把全部补丁分批交给上传线程：VBO 由上传线程写入，完成回调在 GL 线程上创建 VAO 并标记补丁可绘制
+// 完成回调按提交顺序执行，已上传的补丁仍是编号连续的前缀
+//----------------------------------------------------------------------
+void LandScapeMap::submitPatchUploads()
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    size_t patchBytes = (size_t)iVertexStride * iPatchSize * iPatchSize;
+    createPatchBuffers(nullptr);
+    if (eRenderMode == LAND_RENDER_INSTANCED)
+    {
+        // 每个请求写入一行补丁的高度
+        unsigned int uiTexture = uiHeightTex;
+        for (int iRow = 0; iRow < iNumPatchesPerSide; iRow++)
+        {
+            int iEnd = (iRow + 1) * iNumPatchesPerSide;
+            pUploadThread->submit([this, uiTexture, iRow]
+                                  { uploadHeightRows(uiTexture, iRow, iRow + 1); },
+                                  [this, iEnd, iNumPatches]
+                                  {
+                iResidentPatches = iEnd;
+                fLoadProgress = (float)iEnd / iNumPatches;
+                if (iEnd == iNumPatches)
+                {
+                    finishUpload();
+                } });
+        }
+        return;
+    }
+    for (int iBegin = 0; iBegin < iNumPatches; iBegin += LAND_UPLOAD_BATCH)
+    {
+        int iEnd = std::min(iBegin + LAND_UPLOAD_BATCH, iNumPatches);
+        const unsigned char *batchVertices = pCacheVertices + patchBytes * iBegin;
+        std::function<void()> onComplete = [this, iBegin, iEnd, iNumPatches]
+        {
+            iResidentPatches = iEnd;
+            fLoadProgress = (float)iEnd / iNumPatches;
+            if (iEnd == iNumPatches)
+            {
+                finishUpload();
+            }
+        };
+        if (eRenderMode == LAND_RENDER_BATCHED)
+        {
+            unsigned int VBO = uiBatchVBO;
+            pUploadThread->submit([VBO, iBegin, iEnd, patchBytes, batchVertices]
+                                  {
+                glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                glBufferSubData(GL_ARRAY_BUFFER, patchBytes * iBegin, patchBytes * (iEnd - iBegin), batchVertices);
+                glBindBuffer(GL_ARRAY_BUFFER, 0); },
+                                  onComplete);
+            continue;
+        }
+        std::shared_ptr<std::vector<unsigned int>> VBOs = std::make_shared<std::vector<unsigned int>>(iEnd - iBegin);
+        pUploadThread->submit([VBOs, patchBytes, batchVertices]
+                              {
+            glGenBuffers((GLsizei)VBOs->size(), VBOs->data());
+            for (size_t i = 0; i < VBOs->size(); i++)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, (*VBOs)[i]);
+                glBufferData(GL_ARRAY_BUFFER, patchBytes, batchVertices + patchBytes * i, GL_STATIC_DRAW);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0); },
+                              [this, VBOs, iBegin, onComplete]
+                              {
+            for (size_t i = 0; i < VBOs->size(); i++)
+            {
+                LandPatches[iBegin + i].VAO = createPatchVAO((*VBOs)[i]);
+            }
+            onComplete(); });
+    }
+}
+
+//----------------------------------------------------------------------
+// 构建补丁 (x, y) 的顶点：统计高度范围写入 bounds[0..1]，计算各等级几何误差，顶点写入 dst
+// dst 为空时只统计高度范围和几何误差，实例化绘制不需要顶点
+// patchHeights、morphTargets 为调用者提供的暂存区，各 iPatchSize * iPatchSize 个 float
+// 只写入该补丁自己的数据，可以在多个线程上同时构建不同的补丁
+//----------------------------------------------------------------------
+void LandScapeMap::buildPatchVertices(const HeightMap &heightMap, int x, int y, float *patchHeights, float *morphTargets, float *bounds, unsigned char *dst)
+{
+    int iPatch = y * iNumPatchesPerSide + x;
+    int iVertsPerPatch = iPatchSize * iPatchSize;
+    // 补丁左下角在高度图中的坐标
+    int ox = x * (iPatchSize - 1);
+    int oy = y * (iPatchSize - 1);
+    // 计算补丁的顶点高度，16 位格式直接取共享的量化高度
+    for (int32_t j = 0; j < iPatchSize; j++)
+    {
+        for (int32_t i = 0; i < iPatchSize; i++)
+        {
+            patchHeights[j * iPatchSize + i] = eVertexFormat == LAND_VERTEX_HEIGHT_U16 ? getHeight(ox + i, oy + j) : 4000 * heightMap.getHeight(ox + i, oy + j);
+        }
+    }
+    // 统计补丁的高度范围
+    float fPatchMin = std::numeric_limits<float>::max();
+    float fPatchMax = std::numeric_limits<float>::lowest();
+    for (int32_t k = 0; k < iVertsPerPatch; k++)
+    {
+        fPatchMin = std::min(fPatchMin, patchHeights[k]);
+        fPatchMax = std::max(fPatchMax, patchHeights[k]);
+    }
+    bounds[0] = fPatchMin;
+    bounds[1] = fPatchMax;
+    // 预计算各等级的几何误差
+    ComputePatchErrors(patchHeights, iPatchSize, iMaxLOD, &PatchErrors[(size_t)iPatch * (iMaxLOD + 1)]);
+    if (dst == nullptr)
+    {
+        return;
+    }
+    if (bGeomorph)
+    {
+        ComputeMorphTargets(patchHeights, iPatchSize, iMaxLOD, morphTargets);
+    }
+
+    // 写入顶点数据
+    for (int32_t k = 0; k < iVertsPerPatch; k++)
+    {
+        writeHeight(&dst[(size_t)k * iVertexStride], patchHeights[k]);
+        if (bGeomorph)
+        {
+            writeHeight(&dst[(size_t)k * iVertexStride + iComponentSize], morphTargets[k]);
+        }
+    }
+}
+
+bool LandScapeMap::bakePatchCache()
+{
+    return loadHeightMap(false);
+}
+
+//----------------------------------------------------------------------
+// 读取高度图并烘焙补丁缓存
+// bLoading 为 true 时在加载过程中调用：烘焙后映射新缓存并填写补丁；缓存无法写入或读回时
+// 改为用已经解码的高度图在内存中构建补丁数据，不会因为缓存失败而放弃一张有效的高度图
+//----------------------------------------------------------------------
+bool LandScapeMap::loadHeightMap(bool bLoading)
+{
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!GetFileStamp(strHeightMapFile.c_str(), sourceSize, sourceTime))
+    {
+        std::cerr << "Error opening height map: " << strHeightMapFile << std::endl;
+        return false;
+    }
+    // 读取高度图数据
+    iLoadStage = LAND_LOAD_DECODING;
+    fLoadProgress = 0.0f;
+    HeightMap heightMap(strHeightMapFile.c_str());
+    if (!heightMap.isLoaded())
+    {
+        return false;
+    }
+    iLoadStage = LAND_LOAD_BUILDING;
+    buildHeightStore(heightMap);
+
+    if (writePatchCache(heightMap, sourceSize, sourceTime) && (!bLoading || readPatchCache()))
+    {
+        return true;
+    }
+    if (!bLoading || bCancelLoad)
+    {
+        return false;
+    }
+    std::cerr << "Patch cache unavailable, building patches in memory: " << strCacheFile << std::endl;
+    return buildPatchesInMemory(heightMap);
+}
+
+//----------------------------------------------------------------------
+// 计算量化参数并生成整张地图共享的量化高度，16 位顶点格式之后只用量化高度，释放浮点高度图
+//----------------------------------------------------------------------
+void LandScapeMap::buildHeightStore(HeightMap &heightMap)
+{
+    // 计算量化参数，整张地图共用一组 uHeightScale/uHeightBias
+    float fMinHeight, fMaxHeight;
+    heightMap.getRange(fMinHeight, fMaxHeight);
+    fMinHeight *= 4000;
+    fMaxHeight *= 4000;
+    fStoreScale = fMaxHeight > fMinHeight ? (fMaxHeight - fMinHeight) / 65535.0f : 1.0f;
+    fStoreBias = fMinHeight;
+
+    // 生成共享的量化高度
+    iStoreSize = iNumPatchesPerSide * (iPatchSize - 1) + 1;
+    HeightStore.resize((size_t)iStoreSize * iStoreSize);
+    // 按 256 x 256 的块分给任务调度器，每块只读写高度图的一小片，缓存友好
+    JobSystem::instance().parallelFor2D(iStoreSize, iStoreSize, 256, 256, [&](int x0, int y0, int x1, int y1)
+                                        {
+        for (int32_t y = y0; y < y1; y++)
+        {
+            for (int32_t x = x0; x < x1; x++)
+            {
+                float z = 4000 * heightMap.getHeight(x, y);
+                HeightStore[(size_t)y * iStoreSize + x] = (unsigned short)((z - fStoreBias) / fStoreScale + 0.5f);
+            }
+        } });
+    setupVertexFormat();
+    if (eVertexFormat == LAND_VERTEX_HEIGHT_U16)
+    {
+        // 之后只用量化高度，浮点高度图可以提前释放
+        heightMap.release();
+    }
+}
+
+//----------------------------------------------------------------------
+// 构建补丁高度范围、几何误差和顶点写入缓存文件，要求 buildHeightStore 已经执行
+// 实例化绘制不写顶点段；取消加载或写入失败时删除临时文件并返回 false
+//----------------------------------------------------------------------
+bool LandScapeMap::writePatchCache(const HeightMap &heightMap, uint64_t sourceSize, int64_t sourceTime)
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    int iVertsPerPatch = iPatchSize * iPatchSize;
+    bool bVertices = eRenderMode != LAND_RENDER_INSTANCED;
+    PatchCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PATCH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PATCH_CACHE_VERSION;
+    header.headerSize = sizeof(header);
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.iPatchSize = iPatchSize;
+    header.iNumPatchesPerSide = iNumPatchesPerSide;
+    header.iMaxLOD = iMaxLOD;
+    header.iVertexFormat = (int32_t)eVertexFormat;
+    header.iGeomorph = bGeomorph ? 1 : 0;
+    header.iVertexStride = iVertexStride;
+    header.iStoreSize = iStoreSize;
+    header.fHeightScale = fHeightScale;
+    header.fHeightBias = fHeightBias;
+    header.fStoreScale = fStoreScale;
+    header.fStoreBias = fStoreBias;
+    header.boundsOffset = AlignPatchCache(sizeof(header));
+    header.errorsOffset = AlignPatchCache(header.boundsOffset + sizeof(float) * 2 * iNumPatches);
+    header.storeOffset = AlignPatchCache(header.errorsOffset + sizeof(float) * (iMaxLOD + 1) * iNumPatches);
+    if (bVertices)
+    {
+        header.verticesOffset = AlignPatchCache(header.storeOffset + sizeof(unsigned short) * HeightStore.size());
+        header.fileSize = header.verticesOffset + (uint64_t)iVertexStride * iVertsPerPatch * iNumPatches;
+    }
+    else
+    {
+        header.verticesOffset = 0;
+        header.fileSize = header.storeOffset + sizeof(unsigned short) * HeightStore.size();
+    }
+
+    // 先写入临时文件，全部写完后再替换，中途失败不会留下不完整的缓存
+    std::string strTempFile = strCacheFile + ".tmp";
+    FILE *file = fopen(strTempFile.c_str(), "wb");
+    if (file == NULL)
+    {
+        std::cerr << "Error creating patch cache: " << strTempFile << std::endl;
+        return false;
+    }
+    // 顶点段在最后，按补丁行顺序写入，不需要在内存中保留整张地图的顶点
+    bool bOk = !bVertices || SeekFile(file, header.verticesOffset);
+
+    // 一行补丁的顶点暂存区，所有行复用；行内的补丁互不依赖，分给任务调度器并行构建
+    size_t patchBytes = (size_t)iVertexStride * iVertsPerPatch;
+    std::vector<unsigned char> staging(bVertices ? patchBytes * iNumPatchesPerSide : 0);
+    std::vector<float> bounds((size_t)iNumPatches * 2);
+    PatchErrors.assign((size_t)iNumPatches * (iMaxLOD + 1), 0.0f);
+
+    for (int32_t y = 0; y < iNumPatchesPerSide && bOk; y++)
+    {
+        if (bCancelLoad)
+        {
+            fclose(file);
+            remove(strTempFile.c_str());
+            return false;
+        }
+        JobSystem::instance().parallelFor(iNumPatchesPerSide, 1, [&](int iBegin, int iEnd)
+                                          {
+            std::vector<float> patchHeights(iVertsPerPatch);
+            std::vector<float> morphTargets(iVertsPerPatch);
+            for (int32_t x = iBegin; x < iEnd; x++)
+            {
+                int iPatch = y * iNumPatchesPerSide + x;
+                buildPatchVertices(heightMap, x, y, patchHeights.data(), morphTargets.data(), &bounds[iPatch * 2], bVertices ? &staging[patchBytes * x] : nullptr);
+            } });
+        bOk = fwrite(staging.data(), 1, staging.size(), file) == staging.size();
+        fLoadProgress = (float)(y + 1) / iNumPatchesPerSide;
+    }
+
+    bOk = bOk && SeekFile(file, header.boundsOffset) && fwrite(bounds.data(), sizeof(float), bounds.size(), file) == bounds.size();
+    bOk = bOk && SeekFile(file, header.errorsOffset) && fwrite(PatchErrors.data(), sizeof(float), PatchErrors.size(), file) == PatchErrors.size();
+    bOk = bOk && SeekFile(file, header.storeOffset) && fwrite(HeightStore.data(), sizeof(unsigned short), HeightStore.size(), file) == HeightStore.size();
+    // 文件头最后写入
+    bOk = bOk && SeekFile(file, 0) && fwrite(&header, sizeof(header), 1, file) == 1;
+    bOk = fclose(file) == 0 && bOk;
+    if (!bOk)
+    {
+        std::cerr << "Error writing patch cache: " << strTempFile << std::endl;
+        remove(strTempFile.c_str());
+        return false;
+    }
+    remove(strCacheFile.c_str());
+    if (rename(strTempFile.c_str(), strCacheFile.c_str()) != 0)
+    {
+        std::cerr << "Error renaming patch cache: " << strCacheFile << std::endl;
+        remove(strTempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 补丁缓存不可用时在内存中构建补丁数据并填写补丁，要求 buildHeightStore 已经执行
+// 顶点放在 PatchVertices 中，上传方式与映射的缓存相同，上传完成后释放；取消加载时返回 false
+//----------------------------------------------------------------------
+bool LandScapeMap::buildPatchesInMemory(const HeightMap &heightMap)
+{
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    int iVertsPerPatch = iPatchSize * iPatchSize;
+    size_t patchBytes = (size_t)iVertexStride * iVertsPerPatch;
+    bool bVertices = eRenderMode != LAND_RENDER_INSTANCED;
+    PatchVertices.resize(bVertices ? patchBytes * iNumPatches : 0);
+    std::vector<float> bounds((size_t)iNumPatches * 2);
+    PatchErrors.assign((size_t)iNumPatches * (iMaxLOD + 1), 0.0f);
+
+    // 补丁网格按 4 x 4 块分给任务调度器，补丁之间互不依赖
+    std::atomic<int> iBuilt(0);
+    JobSystem::instance().parallelFor2D(iNumPatchesPerSide, iNumPatchesPerSide, 4, 4, [&](int x0, int y0, int x1, int y1)
+                                        {
+        if (bCancelLoad)
+        {
+            return;
+        }
+        std::vector<float> patchHeights(iVertsPerPatch);
+        std::vector<float> morphTargets(iVertsPerPatch);
+        for (int32_t y = y0; y < y1; y++)
+        {
+            for (int32_t x = x0; x < x1; x++)
+            {
+                int iPatch = y * iNumPatchesPerSide + x;
+                buildPatchVertices(heightMap, x, y, patchHeights.data(), morphTargets.data(), &bounds[iPatch * 2], bVertices ? &PatchVertices[patchBytes * iPatch] : nullptr);
+            }
+        }
+        int iDone = iBuilt += (x1 - x0) * (y1 - y0);
+        fLoadProgress = (float)iDone / iNumPatches; });
+    if (bCancelLoad)
+    {
+        std::vector<unsigned char>().swap(PatchVertices);
+        return false;
+    }
+    pCacheVertices = bVertices ? PatchVertices.data() : nullptr;
+    initPatches(bounds.data(), pCacheVertices);
+    return true;
+}
+
+bool LandScapeMap::preparePatches()
+{
+    if (!readPatchCache() && !loadHeightMap(true))
+    {
+        if (!bCancelLoad)
+        {
+            std::cerr << "Error loading height map: " << strHeightMapFile << std::endl;
+        }
+        iLoadStage = LAND_LOAD_FAILED;
+        return false;
+    }
+    fLoadProgress = 0.0f;
+    iLoadStage = LAND_LOAD_UPLOADING;
+    return true;
+}
+
+void LandScapeMap::checkRenderMode()
+{
+    if (eRenderMode != LAND_RENDER_INSTANCED)
+    {
+        return;
+    }
+    GLint iMaxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &iMaxTextureSize);
+    int iSize = iNumPatchesPerSide * (iPatchSize - 1) + 1;
+    if (iSize > iMaxTextureSize)
+    {
+        std::cerr << "Height texture too large for instanced rendering: " << iSize << " > " << iMaxTextureSize << ", using batched rendering" << std::endl;
+        eRenderMode = LAND_RENDER_BATCHED;
+        return;
+    }
+    // 实例属性只能从环形缓冲区提供，在加载补丁之前创建，失败时同样退回批量绘制
+    if (!InstanceRing.init(GL_ARRAY_BUFFER, sizeof(LandPatchInstance) * iNumPatchesPerSide * iNumPatchesPerSide, 3))
+    {
+        std::cerr << "Failed to create instance buffer, using batched rendering" << std::endl;
+        eRenderMode = LAND_RENDER_BATCHED;
+    }
+}
+
+void LandScapeMap::init()
+{
+    checkRenderMode();
+    if (!initIndices() || !preparePatches())
+    {
+        return;
+    }
+    uploadPatches(-1.0);
+}
+
+void LandScapeMap::initAsync()
+{
+    checkRenderMode();
+    if (!initIndices())
+    {
+        iLoadStage = LAND_LOAD_FAILED;
+        return;
+    }
+    fLoadProgress = 0.0f;
+    iLoadStage = LAND_LOAD_DECODING;
+    LoadJob = JobSystem::instance().submit([this]
+                                           { preparePatches(); });
+    JobSystem::instance().submitMain([this]
+                                     { uploadSlice(); },
+                                     {LoadJob});
+}
+
+bool LandScapeMap::initFromGpuTerrain(const GpuTerrain &terrain, float fHeightRange)
+{
+    checkRenderMode();
+    iStoreSize = iNumPatchesPerSide * (iPatchSize - 1) + 1;
+    std::vector<float> heights;
+    if (eRenderMode != LAND_RENDER_INSTANCED || terrain.getSize() != iStoreSize)
+    {
+        std::cerr << "GPU terrain requires instanced rendering and a " << iStoreSize << "x" << iStoreSize << " height texture" << std::endl;
+        iLoadStage = LAND_LOAD_FAILED;
+        return false;
+    }
+    if (!initIndices() || !terrain.readback(heights))
+    {
+        iLoadStage = LAND_LOAD_FAILED;
+        return false;
+    }
+    iLoadStage = LAND_LOAD_BUILDING;
+
+    // 与 R16 纹理的取值一致：世界高度 = 归一化高度 * fHeightRange
+    fStoreScale = fHeightRange / 65535.0f;
+    fStoreBias = 0.0f;
+    setupVertexFormat();
+    HeightStore.resize(heights.size());
+    for (size_t k = 0; k < heights.size(); k++)
+    {
+        HeightStore[k] = (unsigned short)(std::min(std::max(heights[k], 0.0f), 1.0f) * 65535.0f + 0.5f);
+    }
+    std::vector<float>().swap(heights);
+
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    int iVertsPerPatch = iPatchSize * iPatchSize;
+    PatchErrors.assign((size_t)iNumPatches * (iMaxLOD + 1), 0.0f);
+    JobSystem::instance().parallelFor(iNumPatches, 0, [&](int iBegin, int iEnd)
+                                      {
+        std::vector<float> patchHeights(iVertsPerPatch);
+        for (int iPatch = iBegin; iPatch < iEnd; iPatch++)
+        {
+            int ox = (iPatch % iNumPatchesPerSide) * (iPatchSize - 1);
+            int oy = (iPatch / iNumPatchesPerSide) * (iPatchSize - 1);
+            float fPatchMin = std::numeric_limits<float>::max();
+            float fPatchMax = std::numeric_limits<float>::lowest();
+            for (int j = 0; j < iPatchSize; j++)
+            {
+                for (int i = 0; i < iPatchSize; i++)
+                {
+                    float z = getHeight(ox + i, oy + j);
+                    patchHeights[j * iPatchSize + i] = z;
+                    fPatchMin = std::min(fPatchMin, z);
+                    fPatchMax = std::max(fPatchMax, z);
+                }
+            }
+            initPatch(iPatch, fPatchMin, fPatchMax);
+            ComputePatchErrors(patchHeights.data(), iPatchSize, iMaxLOD, &PatchErrors[(size_t)iPatch * (iMaxLOD + 1)]);
+        } });
+    QuadTree.clear();
+    QuadTree.reserve(iNumPatches * 2);
+    buildQuadNode(0, 0, iNumPatchesPerSide, iNumPatchesPerSide);
+
+    // 高度已经在纹理中，没有需要上传的内容
+    uiHeightTex = terrain.getTexture();
+    bOwnsHeightTex = false;
+    createPatchBuffers(nullptr);
+    iResidentPatches = iNumPatches;
+    finishUpload();
+    return true;
+}
+
+void LandScapeMap::uploadSlice()
+{
+    if (iLoadStage != LAND_LOAD_UPLOADING || bCancelLoad)
+    {
+        return;
+    }
+    if (pUploadThread != nullptr && pUploadThread->isRunning())
+    {
+        submitPatchUploads();
+    }
+    else if (!uploadPatches(LAND_UPLOAD_SLICE_MS))
+    {
+        JobSystem::instance().submitMain([this]
+                                         { uploadSlice(); });
+    }
+}
+
+void LandScapeMap::waitLoading()
+{
+    bCancelLoad = true;
+    JobSystem::instance().wait(LoadJob);
+}
+
+bool LandScapeMap::selfTestGpuCulling()
+{
+    if (getLoadStage() != LAND_LOAD_READY || !createGpuCuller())
+    {
+        return false;
+    }
+    float fPixelsPerUnit = 600.0f / (2.0f * std::tan(glm::radians(45.0f) * 0.5f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100000.0f);
+    float fExtent = (float)(iStoreSize - 1);
+    // 相机位置与观察点（以地图边长为单位，高度为世界单位）：地图外的高空、贴近地面、陡峭俯视、斜穿地图
+    const glm::vec3 cameras[4][2] = {
+        {glm::vec3(-0.2f, -0.2f, 1500.0f), glm::vec3(0.5f, 0.5f, 0.0f)},
+        {glm::vec3(0.5f, 0.3f, 300.0f), glm::vec3(0.5f, 1.0f, 0.0f)},
+        {glm::vec3(0.3f, 0.7f, 2000.0f), glm::vec3(0.4f, 0.6f, 0.0f)},
+        {glm::vec3(0.9f, 0.1f, 400.0f), glm::vec3(0.1f, 0.9f, 100.0f)},
+    };
+    // 浮点误差的相对容差：等级切换距离与裁剪平面附近的补丁允许 CPU 与 GPU 的结果不同
+    const float fEpsilon = 1e-4f;
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    bool bPassed = true;
+    int iMinLOD = iMaxLOD;
+    int iMaxSeenLOD = 0;
+    for (int c = 0; c < 4; c++)
+    {
+        glm::vec3 eye(cameras[c][0].x * fExtent, cameras[c][0].y * fExtent, cameras[c][0].z);
+        glm::vec3 target(cameras[c][1].x * fExtent, cameras[c][1].y * fExtent, cameras[c][1].z);
+        Frustum frustum;
+        frustum.extract(projection * glm::lookAt(eye, target, glm::vec3(0.0f, 0.0f, 1.0f)));
+
+        selectPatchLODs(eye, frustum, fPixelsPerUnit);
+        GpuCuller.cull(frustum, eye, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+        std::vector<int> lods;
+        GLuint uiDrawCount = 0;
+        GpuCuller.readback(lods, uiDrawCount);
+
+        // GPU 结果允许的范围：误差阈值放大、缩小 fEpsilon 分别选出每个补丁等级的下限和上限，
+        // 贴着裁剪平面的补丁在下限中可见、在上限中不可见，再按相邻等级约束；约束只会随等级升高、可见补丁减少而放宽，
+        // 所以两次约束的结果就是 GPU 结果的下限和上限。贴着裁剪平面的补丁自身的上限为约束前的等级
+        std::vector<int> lowVisible, highVisible;
+        std::vector<int> lowLODs(iNumPatches, -1), highLODs(iNumPatches, -1), rawHighLODs(iNumPatches, -1);
+        for (int iPatch = 0; iPatch < iNumPatches; iPatch++)
+        {
+            const LandPatch &patch = LandPatches[iPatch];
+            bool bNearPlane = IsNearFrustumPlane(frustum, glm::vec3(patch.imin_x, patch.imin_y, patch.fMinHeight), glm::vec3(patch.imax_x, patch.imax_y, patch.fMaxHeight), fEpsilon);
+            if (FrameLODs[iPatch] < 0 && !bNearPlane)
+            {
+                continue;
+            }
+            lowLODs[iPatch] = selectLOD(iPatch, eye, fPixelsPerUnit * (1.0f + fEpsilon));
+            rawHighLODs[iPatch] = selectLOD(iPatch, eye, fPixelsPerUnit * (1.0f - fEpsilon));
+            lowVisible.push_back(iPatch);
+            if (!bNearPlane)
+            {
+                highLODs[iPatch] = rawHighLODs[iPatch];
+                highVisible.push_back(iPatch);
+            }
+        }
+        constrainPatchLODs(lowVisible, lowLODs);
+        constrainPatchLODs(highVisible, highLODs);
+
+        int iMismatches = 0;
+        int iOutOfRange = 0;
+        GLuint uiGpuVisible = 0;
+        for (int p = 0; p < iNumPatches; p++)
+        {
+            iMismatches += lods[p] != FrameLODs[p] ? 1 : 0;
+            if (FrameLODs[p] >= 0)
+            {
+                iMinLOD = std::min(iMinLOD, FrameLODs[p]);
+                iMaxSeenLOD = std::max(iMaxSeenLOD, FrameLODs[p]);
+            }
+            if (lods[p] < 0)
+            {
+                // 上限中可见的补丁一定可见
+                iOutOfRange += highLODs[p] >= 0 ? 1 : 0;
+                continue;
+            }
+            uiGpuVisible++;
+            int iHigh = highLODs[p] >= 0 ? highLODs[p] : rawHighLODs[p];
+            iOutOfRange += lowLODs[p] < 0 || lods[p] < lowLODs[p] || lods[p] > iHigh ? 1 : 0;
+        }
+        bool bMatch = iOutOfRange == 0 && uiDrawCount == uiGpuVisible && !VisiblePatches.empty();
+        std::cout << "GPU culling camera " << c << ": " << VisiblePatches.size() << " visible, " << uiDrawCount << " GPU draws, "
+                  << iMismatches << " mismatches, " << iOutOfRange << " outside floating-point tolerance" << (bMatch ? "" : " FAILED") << std::endl;
+        bPassed = bPassed && bMatch;
+    }
+    // 所有相机都选出同一个等级时比较不出等级选择的差异
+    if (iMaxSeenLOD - iMinLOD < 2)
+    {
+        std::cout << "GPU culling cameras only cover LODs " << iMinLOD << " to " << iMaxSeenLOD << ", FAILED" << std::endl;
+        bPassed = false;
+    }
+    if (!bGpuCulling)
+    {
+        GpuCuller.release();
+    }
+    return bPassed;
+}
+
+void LandScapeMap::release()
+{
+    MorphRing.release();
+    InstanceRing.release();
+    GpuCuller.release();
+    int iNumPatches = iNumPatchesPerSide * iNumPatchesPerSide;
+    for (int iPatch = 0; iPatch < iNumPatches; iPatch++)
+    {
+        LandPatch &patch = LandPatches[iPatch];
+        if (patch.VAO != 0 && patch.VAO != uiBatchVAO)
+        {
+            // 逐补丁绘制时每个补丁有自己的 VBO，只记录在 VAO 中
+            GLint iVBO = 0;
+            glBindVertexArray(patch.VAO);
+            glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &iVBO);
+            glBindVertexArray(0);
+            GLuint VBO = (GLuint)iVBO;
+            glDeleteBuffers(1, &VBO);
+            glDeleteVertexArrays(1, &patch.VAO);
+        }
+        patch.VAO = 0;
+    }
+    GLuint *vertexArrays[2] = {&uiBatchVAO, &uiInstanceVAO};
+    for (int i = 0; i < 2; i++)
+    {
+        if (*vertexArrays[i])
+        {
+            glDeleteVertexArrays(1, vertexArrays[i]);
+            *vertexArrays[i] = 0;
+        }
+    }
+    GLuint *buffers[4] = {&uiBatchVBO, &uiGridVBO, &uiIndexEBO, &uiPatchDataTBO};
+    for (int i = 0; i < 4; i++)
+    {
+        if (*buffers[i])
+        {
+            glDeleteBuffers(1, buffers[i]);
+            *buffers[i] = 0;
+        }
+    }
+    if (uiPatchDataTex)
+    {
+        glDeleteTextures(1, &uiPatchDataTex);
+        uiPatchDataTex = 0;
+    }
+    // GpuTerrain 的高度纹理由 GpuTerrain 释放
+    if (uiHeightTex && bOwnsHeightTex)
+    {
+        glDeleteTextures(1, &uiHeightTex);
+    }
+    uiHeightTex = 0;
+    bOwnsHeightTex = false;
+    iResidentPatches = 0;
+    iLoadStage = LAND_LOAD_IDLE;
+}
+
+float LandScapeMap::getLoadProgress() const
+{
+    float fStage = fLoadProgress;
+    switch (getLoadStage())
+    {
+    case LAND_LOAD_DECODING:
+        return 0.2f * fStage;
+    case LAND_LOAD_BUILDING:
+        return 0.2f + 0.5f * fStage;
+    case LAND_LOAD_UPLOADING:
+        return 0.7f + 0.3f * fStage;
+    case LAND_LOAD_READY:
+        return 1.0f;
+    default:
+        return 0.0f;
+    }
+}
+
+int LandScapeMap::selectLOD(int iPatch, const glm::vec3 &eye_position, float fPixelsPerUnit) const
+{
+    const LandPatch &patch = LandPatches[iPatch];
+    // 相机到补丁包围盒的最近距离
+    glm::vec3 vMin(patch.imin_x, patch.imin_y, patch.fMinHeight);
+    glm::vec3 vMax(patch.imax_x, patch.imax_y, patch.fMaxHeight);
+    float d = glm::distance(eye_position, glm::clamp(eye_position, vMin, vMax));
+    // 在包围盒内时使用最精细的等级
+    if (d <= 0.0f)
+    {
+        return 0;
+    }
+
+    // 几何误差随等级单调不减，从最粗的等级开始找第一个满足要求的
+    float fMaxError = fPixelError * d / fPixelsPerUnit;
+    const float *errors = &PatchErrors[(size_t)iPatch * (iMaxLOD + 1)];
+    for (int lod = iMaxLOD; lod > 0; lod--)
+    {
+        if (errors[lod] <= fMaxError)
+        {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+void LandScapeMap::selectPatchLODs(const glm::vec3 &eye_position, const Frustum &frustum, float fPixelsPerUnit)
+{
+    VisiblePatches.clear();
+    if (!QuadTree.empty())
+    {
+        cullQuadNode(0, frustum, false);
+    }
+    if (getLoadStage() == LAND_LOAD_UPLOADING)
+    {
+        // 还没有上传的补丁按不可见处理
+        int iResident = iResidentPatches;
+        VisiblePatches.erase(std::remove_if(VisiblePatches.begin(), VisiblePatches.end(), [iResident](int iPatch)
+                                            { return iPatch >= iResident; }),
+                             VisiblePatches.end());
+    }
+
+    // 选择可见补丁的等级，每个补丁只写自己的等级，可见补丁多时分给任务调度器
+    FrameLODs.assign((size_t)iNumPatchesPerSide * iNumPatchesPerSide, -1);
+    JobSystem::instance().parallelFor((int)VisiblePatches.size(), LAND_LOD_GRAIN, [&](int iBegin, int iEnd)
+                                      {
+        for (int v = iBegin; v < iEnd; v++)
+        {
+            FrameLODs[VisiblePatches[v]] = selectLOD(VisiblePatches[v], eye_position, fPixelsPerUnit);
+        } });
+    constrainPatchLODs(VisiblePatches, FrameLODs);
+}
+
+//----------------------------------------------------------------------
+// 相邻可见补丁的等级最多相差 1，接缝版本才能补齐裂缝；较粗的一方向细的靠拢，反复放宽直到不变
+// visible: 可见补丁，lods: 每个补丁的等级，不可见为 -1
+//----------------------------------------------------------------------
+void LandScapeMap::constrainPatchLODs(const std::vector<int> &visible, std::vector<int> &lods) const
+{
+    bool bChanged = true;
+    while (bChanged)
+    {
+        bChanged = false;
+        for (size_t v = 0; v < visible.size(); v++)
+        {
+            int iPatch = visible[v];
+            int x = iPatch % iNumPatchesPerSide;
+            int y = iPatch / iNumPatchesPerSide;
+            int iLimit = lods[iPatch] + 1;
+            const int neighbors[4][2] = {{x - 1, y}, {x, y + 1}, {x + 1, y}, {x, y - 1}};
+            for (int n = 0; n < 4; n++)
+            {
+                if (neighbors[n][0] < 0 || neighbors[n][0] >= iNumPatchesPerSide || neighbors[n][1] < 0 || neighbors[n][1] >= iNumPatchesPerSide)
+                {
+                    continue;
+                }
+                int &iNeighborLOD = lods[neighbors[n][1] * iNumPatchesPerSide + neighbors[n][0]];
+                if (iNeighborLOD > iLimit)
+                {
+                    iNeighborLOD = iLimit;
+                    bChanged = true;
+                }
+            }
+        }
+    }
+}
+
+float LandScapeMap::computeMorph(int iPatch, int lod, const glm::vec3 &eye_position, float fPixelsPerUnit) const
+{
+    if (lod >= iMaxLOD)
+    {
+        return 0.0f;
+    }
+    const LandPatch &patch = LandPatches[iPatch];
+    glm::vec3 vMin(patch.imin_x, patch.imin_y, patch.fMinHeight);
+    glm::vec3 vMax(patch.imax_x, patch.imax_y, patch.fMaxHeight);
+    float d = glm::distance(eye_position, glm::clamp(eye_position, vMin, vMax));
+
+    // 该等级开始使用和切换到下一等级时的距离，与 selectLOD 的判断一致
+    const float *errors = &PatchErrors[(size_t)iPatch * (iMaxLOD + 1)];
+    float fStart = errors[lod] * fPixelsPerUnit / fPixelError;
+    float fEnd = errors[lod + 1] * fPixelsPerUnit / fPixelError;
+    float fRange = (fEnd - fStart) * fMorphRange;
+    if (fRange <= 0.0f)
+    {
+        return d >= fEnd ? 1.0f : 0.0f;
+    }
+    return glm::clamp((d - (fEnd - fRange)) / fRange, 0.0f, 1.0f);
+}
+
+void LandScapeMap::updatePatchMorph(int iPatch)
+{
+    int x = iPatch % iNumPatchesPerSide;
+    int y = iPatch / iNumPatchesPerSide;
+    int lod = FrameLODs[iPatch];
+    float fMorph = FrameMorphs[iPatch];
+    const int neighbors[4][2] = {{x - 1, y}, {x, y + 1}, {x + 1, y}, {x, y - 1}};
+    float fEdge[4];
+    for (int n = 0; n < 4; n++)
+    {
+        fEdge[n] = fMorph;
+        if (neighbors[n][0] < 0 || neighbors[n][0] >= iNumPatchesPerSide || neighbors[n][1] < 0 || neighbors[n][1] >= iNumPatchesPerSide)
+        {
+            continue;
+        }
+        int iNeighbor = neighbors[n][1] * iNumPatchesPerSide + neighbors[n][0];
+        if (FrameLODs[iNeighbor] == lod)
+        {
+            fEdge[n] = std::max(fMorph, FrameMorphs[iNeighbor]);
+        }
+        else if (FrameLODs[iNeighbor] >= 0 && FrameLODs[iNeighbor] < lod)
+        {
+            fEdge[n] = 0.0f;
+        }
+    }
+    PatchMorphData[(size_t)iPatch * 2] = glm::vec4((float)lod, fMorph, 0.0f, 0.0f);
+    PatchMorphData[(size_t)iPatch * 2 + 1] = glm::vec4(fEdge[0], fEdge[1], fEdge[2], fEdge[3]);
+}
+
+void LandScapeMap::render(glm::vec3 eye_position, const glm::mat4 &viewProjection, float fFovY, float fViewportHeight)
+{
+    // 补丁数据和四叉树在进入上传阶段前由工作线程写入，此前没有可绘制的补丁
+    LandLoadStage eStage = getLoadStage();
+    if ((eStage != LAND_LOAD_UPLOADING && eStage != LAND_LOAD_READY) || iResidentPatches == 0)
+    {
+        return;
+    }
+
+    // 还原顶点 XY 需要的参数，要求地形着色器已经通过 glUseProgram 启用
+    glUniform1i(iPatchSizeLoc, iPatchSize);
+    glUniform1i(iPatchesPerSideLoc, iNumPatchesPerSide);
+    glUniform1i(iVertexOffsetLoc, 0);
+    glUniform1i(iMaxLODLoc, iMaxLOD);
+    glUniform1i(iGeomorphLoc, bGeomorph ? 1 : 0);
+    if (eRenderMode == LAND_RENDER_INSTANCED)
+    {
+        // 高度纹理归一化后的 [0, 1] 换算回量化值再换算成世界高度
+        glUniform1f(iHeightScaleLoc, fStoreScale * 65535.0f);
+        glUniform1f(iHeightBiasLoc, fStoreBias);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, uiHeightTex);
+        glUniform1i(iHeightMapLoc, 1);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else
+    {
+        glUniform1f(iHeightScaleLoc, fHeightScale);
+        glUniform1f(iHeightBiasLoc, fHeightBias);
+    }
+
+    drawCounts.clear();
+    drawOffsets.clear();
+    drawBaseVertices.clear();
+
+    float fPixelsPerUnit = fViewportHeight / (2.0f * std::tan(fFovY * 0.5f));
+
+    // 视锥体裁剪，整棵子树在视锥体外时一次剔除
+    Frustum frustum;
+    frustum.extract(viewProjection);
+
+    if (bGpuCulling && GpuCuller.isReady())
+    {
+        // 等级、形变数据和绘制命令都在 GPU 上生成，CPU 不再遍历补丁
+        GpuCuller.cull(frustum, eye_position, fPixelsPerUnit, fPixelError, fMorphRange, bGeomorph);
+        if (bGeomorph)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_BUFFER, uiPatchDataTex);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, GpuCuller.getPatchDataBuffer());
+            glUniform1i(iPatchDataLoc, 0);
+        }
+        glBindVertexArray(uiBatchVAO);
+        GpuCuller.draw();
+        return;
+    }
+
+    selectPatchLODs(eye_position, frustum, fPixelsPerUnit);
+
+    if (bGeomorph)
+    {
+        // 先算出所有可见补丁的形变系数，再结合相邻补丁写入边上的系数
+        FrameMorphs.assign(FrameLODs.size(), 0.0f);
+        JobSystem::instance().parallelFor((int)VisiblePatches.size(), LAND_LOD_GRAIN, [&](int iBegin, int iEnd)
+                                          {
+            for (int v = iBegin; v < iEnd; v++)
+            {
+                FrameMorphs[VisiblePatches[v]] = computeMorph(VisiblePatches[v], FrameLODs[VisiblePatches[v]], eye_position, fPixelsPerUnit);
+            } });
+        JobSystem::instance().parallelFor((int)VisiblePatches.size(), LAND_LOD_GRAIN, [&](int iBegin, int iEnd)
+                                          {
+            for (int v = iBegin; v < iEnd; v++)
+            {
+                updatePatchMorph(VisiblePatches[v]);
+            } });
+        size_t morphBytes = sizeof(glm::vec4) * PatchMorphData.size();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, uiPatchDataTex);
+        void *pMorph = nullptr;
+        size_t morphOffset = 0;
+        if (MorphRing.getBuffer())
+        {
+            // 写入环形缓冲区本帧的一段，纹理指向这一段；GPU 仍在读取的前几帧数据不受影响
+            // 分配失败时也在帧末调用 endFrame，非持久映射的段不会一直保持映射
+            MorphRing.beginFrame();
+            bMorphRingUsed = true;
+            pMorph = MorphRing.allocate(morphBytes, uiTexBufferAlignment, morphOffset);
+        }
+        if (pMorph)
+        {
+            memcpy(pMorph, PatchMorphData.data(), morphBytes);
+            MorphRing.flush();
+            glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, MorphRing.getBuffer(), (GLintptr)morphOffset, (GLsizeiptr)morphBytes);
+        }
+        else
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, uiPatchDataTBO);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, morphBytes, PatchMorphData.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, uiPatchDataTBO);
+        }
+        glUniform1i(iPatchDataLoc, 0);
+    }
+
+    FrameVariants.clear();
+    for (size_t v = 0; v < VisiblePatches.size(); v++)
+    {
+        int iPatch = VisiblePatches[v];
+        int x = iPatch % iNumPatchesPerSide;
+        int y = iPatch / iNumPatchesPerSide;
+        int lod = FrameLODs[iPatch];
+        LandPatches[iPatch].iLOD = lod;
+
+        // 根据相邻补丁的等级选择接缝版本；不可见的相邻补丁不会露出接缝，按同级处理
+        int mask = 0;
+        mask |= x > 0 && FrameLODs[iPatch - 1] > lod ? LAND_STITCH_LEFT : 0;
+        mask |= x < iNumPatchesPerSide - 1 && FrameLODs[iPatch + 1] > lod ? LAND_STITCH_RIGHT : 0;
+        mask |= y > 0 && FrameLODs[iPatch - iNumPatchesPerSide] > lod ? LAND_STITCH_DOWN : 0;
+        mask |= y < iNumPatchesPerSide - 1 && FrameLODs[iPatch + iNumPatchesPerSide] > lod ? LAND_STITCH_UP : 0;
+        const LandPatchIndex &variant = LandPatchIndices[lod * LAND_STITCH_VARIANTS + mask];
+
+        if (eRenderMode == LAND_RENDER_INSTANCED)
+        {
+            // 循环结束后按接缝版本分组绘制
+            FrameVariants.push_back(lod * LAND_STITCH_VARIANTS + mask);
+            continue;
+        }
+        if (eRenderMode == LAND_RENDER_BATCHED)
+        {
+            // 只记录绘制参数，循环结束后一次提交
+            drawCounts.push_back(variant.indices_count);
+            drawOffsets.push_back((const void *)(size_t)variant.indices_offset);
+            drawBaseVertices.push_back(iPatch * iPatchSize * iPatchSize);
+            continue;
+        }
+        // 绑定 VAO，一个补丁只需一次绘制；每个补丁的 VBO 都从 0 开始，用 uVertexOffset 还原补丁编号
+        glBindVertexArray(LandPatches[iPatch].VAO);
+        glUniform1i(iVertexOffsetLoc, iPatch * iPatchSize * iPatchSize);
+        glDrawElements(GL_TRIANGLES, variant.indices_count, GL_UNSIGNED_SHORT, (const void *)(size_t)variant.indices_offset);
+    }
+
+    if (eRenderMode == LAND_RENDER_BATCHED && !drawCounts.empty())
+    {
+        glBindVertexArray(uiBatchVAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_SHORT, drawOffsets.data(), (GLsizei)drawCounts.size(), drawBaseVertices.data());
+    }
+    if (eRenderMode == LAND_RENDER_INSTANCED && !FrameVariants.empty())
+    {
+        drawInstances();
+    }
+
+    if (bMorphRingUsed)
+    {
+        // 本帧的绘制已经提交，之后 GPU 读完时才会重用这一段
+        MorphRing.endFrame();
+        bMorphRingUsed = false;
+    }
+}
+
+void LandScapeMap::drawInstances()
+{
+    int iVariants = (iMaxLOD + 1) * LAND_STITCH_VARIANTS;
+    VariantStarts.assign((size_t)iVariants + 1, 0);
+    for (size_t v = 0; v < FrameVariants.size(); v++)
+    {
+        VariantStarts[FrameVariants[v] + 1]++;
+    }
+    for (int i = 0; i < iVariants; i++)
+    {
+        VariantStarts[i + 1] += VariantStarts[i];
+    }
+
+    InstanceRing.beginFrame();
+    size_t instanceOffset = 0;
+    LandPatchInstance *pInstances = (LandPatchInstance *)InstanceRing.allocate(sizeof(LandPatchInstance) * FrameVariants.size(), sizeof(LandPatchInstance), instanceOffset);
+    if (pInstances == nullptr)
+    {
+        // 本帧不绘制，仍然结束这一帧，非持久映射不会一直保持映射
+        InstanceRing.endFrame();
+        return;
+    }
+    // 计数排序，写完后 VariantStarts[i] 为版本 i 的终点，即版本 i + 1 的起点
+    for (size_t v = 0; v < VisiblePatches.size(); v++)
+    {
+        int iPatch = VisiblePatches[v];
+        LandPatchInstance &instance = pInstances[VariantStarts[FrameVariants[v]]++];
+        instance.x = iPatch % iNumPatchesPerSide;
+        instance.y = iPatch / iNumPatchesPerSide;
+        instance.iLOD = FrameLODs[iPatch];
+    }
+    InstanceRing.flush();
+
+    glBindVertexArray(uiInstanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, InstanceRing.getBuffer());
+    int iStart = 0;
+    for (int i = 0; i < iVariants; i++)
+    {
+        int iEnd = VariantStarts[i];
+        if (iEnd > iStart)
+        {
+            const LandPatchIndex &variant = LandPatchIndices[i];
+            glVertexAttribIPointer(2, 3, GL_INT, sizeof(LandPatchInstance), (void *)(instanceOffset + sizeof(LandPatchInstance) * iStart));
+            glDrawElementsInstanced(GL_TRIANGLES, variant.indices_count, GL_UNSIGNED_SHORT, (const void *)(size_t)variant.indices_offset, iEnd - iStart);
+        }
+        iStart = iEnd;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    InstanceRing.endFrame();
+}
+
+float LandScapeMap::getHeight(int x, int y) const
+{
+    if (x < 0 || x >= iStoreSize || y < 0 || y >= iStoreSize)
+    {
+        return 0.0f;
+    }
+    return HeightStore[(size_t)y * iStoreSize + x] * fStoreScale + fStoreBias;
+}
+
+float LandScapeMap::getHeight(float x, float y) const
+{
+    int ix = (int)std::floor(x);
+    int iy = (int)std::floor(y);
+    float fx = x - ix;
+    float fy = y - iy;
+    float h0 = getHeight(ix, iy) * (1 - fx) + getHeight(ix + 1, iy) * fx;
+    float h1 = getHeight(ix, iy + 1) * (1 - fx) + getHeight(ix + 1, iy + 1) * fx;
+    return h0 * (1 - fy) + h1 * fy;
+}
+
+void LandScapeMap::setHeightMapFile(const std::string &filename)
+{
+    strHeightMapFile = filename;
+    strCacheFile = filename + ".patches";
+}
+
+void LandScapeMap::setShader(unsigned int shaderProgram)
+{
+    iPatchSizeLoc = glGetUniformLocation(shaderProgram, "uPatchSize");
+    iPatchesPerSideLoc = glGetUniformLocation(shaderProgram, "uPatchesPerSide");
+    iVertexOffsetLoc = glGetUniformLocation(shaderProgram, "uVertexOffset");
+    iHeightScaleLoc = glGetUniformLocation(shaderProgram, "uHeightScale");
+    iHeightBiasLoc = glGetUniformLocation(shaderProgram, "uHeightBias");
+    iMaxLODLoc = glGetUniformLocation(shaderProgram, "uMaxLOD");
+    iGeomorphLoc = glGetUniformLocation(shaderProgram, "uGeomorph");
+    iPatchDataLoc = glGetUniformLocation(shaderProgram, "uPatchData");
+    iHeightMapLoc = glGetUniformLocation(shaderProgram, "uHeightMap");
+    iModelLoc = glGetUniformLocation(shaderProgram, "model");
+    iViewLoc = glGetUniformLocation(shaderProgram, "view");
+    iProjectionLoc = glGetUniformLocation(shaderProgram, "projection");
+}
+
+void LandScapeMap::setMatrices(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    glUniformMatrix4fv(iModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(iViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(iProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+}
+
+const char *LandScapeMap::getVertexShaderSource() const
+{
+    return eRenderMode == LAND_RENDER_INSTANCED ? instancedVertexShaderSource : vertexShaderSource;
+}
+
+const char *LandScapeMap::getFragmentShaderSource()
+{
+    return fragmentShaderSource;
+}
@@ -0,0 +1,372 @@
+#pragma once
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frustum.h"
+#include "heightmap.h"
+#include "patchcache.h"
+#include "jobsystem.h"
+#include "uploadthread.h"
+#include "ringbuffer.h"
+#include "gputerrain.h"
+#include "gpuculling.h"
+
+struct LandPatch
+{
+    unsigned int VAO;        // 顶点数组对象
+    unsigned char *vertices; // 补丁顶点信息，只有高度，格式见 LandVertexFormat；默认上传后不保留，为 nullptr
+    int iLOD;                // 当前补丁应该使用的等级，与相机距离有关
+    float fDistance;         // 距离相机的距离
+    float ix;
+    float iy;
+    float imin_x;
+    float imin_y;
+    float imax_x;
+    float imax_y;
+    float fMinHeight; // 补丁内的最低高度
+    float fMaxHeight; // 补丁内的最高高度
+};
+
+// 补丁网格上的四叉树节点，包围盒包含高度范围
+struct LandQuadNode
+{
+    glm::vec3 vMin;  // 包围盒最小点
+    glm::vec3 vMax;  // 包围盒最大点
+    int x0, y0;      // 覆盖的补丁范围 [x0, x1) x [y0, y1)
+    int x1, y1;
+    int children[4]; // 子节点编号，-1 表示没有
+};
+
+struct LandPatchIndex
+{
+    unsigned int indices_offset; // 在共享索引缓冲区中的字节偏移（三角形列表，16 位索引）
+    int indices_count;           // 索引数量
+    int iLOD;                    // 索引对应的细节等级
+};
+
+// 地形的绘制方式
+enum LandRenderMode
+{
+    LAND_RENDER_PER_PATCH, // 每个补丁一个 VAO，逐个补丁绘制
+    LAND_RENDER_BATCHED,   // 所有补丁顶点放在一个 VBO 中，一次 glMultiDrawElementsBaseVertex 提交所有可见补丁
+    LAND_RENDER_INSTANCED  // 所有补丁共用一个网格，按等级与接缝版本分组实例化绘制，高度从高度纹理读取
+};
+
+// 实例化绘制时每个可见补丁的实例属性
+struct LandPatchInstance
+{
+    int x, y; // 补丁在补丁网格中的坐标
+    int iLOD; // 补丁的等级
+};
+
+// 地形顶点格式。顶点只保存高度，XY 在顶点着色器中由 gl_VertexID 还原
+enum LandVertexFormat
+{
+    LAND_VERTEX_HEIGHT_FLOAT, // 32 位浮点高度
+    LAND_VERTEX_HEIGHT_U16    // 按整张地图高度范围量化的 16 位高度
+};
+
+// 补丁接缝掩码：对应一侧的相邻补丁更粗糙时置位，该侧边中点不参与三角化
+enum LandStitchMask
+{
+    LAND_STITCH_LEFT = 1,  // x - 1 一侧
+    LAND_STITCH_UP = 2,    // y + 1 一侧
+    LAND_STITCH_RIGHT = 4, // x + 1 一侧
+    LAND_STITCH_DOWN = 8,  // y - 1 一侧
+    LAND_STITCH_VARIANTS = 16
+};
+
+// 异步加载的阶段
+enum LandLoadStage
+{
+    LAND_LOAD_IDLE,      // 尚未开始
+    LAND_LOAD_DECODING,  // 工作线程读取补丁缓存或解码高度图
+    LAND_LOAD_BUILDING,  // 工作线程构建补丁顶点
+    LAND_LOAD_UPLOADING, // GL 线程分批上传，已上传的补丁可以绘制
+    LAND_LOAD_READY,     // 全部补丁已上传
+    LAND_LOAD_FAILED
+};
+
+//----------------------------------------------------------------------
+// 分块几何 mipmap（geomipmapping）地形
+// 高度图切成 iPatchSize x iPatchSize 的补丁，每个补丁按屏幕空间误差选择等级，相邻补丁用接缝版本的索引补齐裂缝。
+// 补丁数据从烘焙的补丁缓存异步加载，可以逐补丁、批量或实例化绘制，也可以在 GPU 上裁剪和选择等级
+//----------------------------------------------------------------------
+class LandScapeMap
+{
+public:
+    LandScapeMap(int m_iSize, int iPatchSize, LandRenderMode eRenderMode = LAND_RENDER_BATCHED, LandVertexFormat eVertexFormat = LAND_VERTEX_HEIGHT_U16);
+
+    //----------------------------------------------------------------------
+    // 烘焙补丁缓存：读取高度图，计算共享量化高度、补丁高度范围、各等级几何误差和全部顶点，写入缓存文件
+    // 实例化绘制不读取顶点，烘焙的缓存不含顶点段
+    // 不需要 GL 上下文，可以离线执行（YK --bake）
+    //----------------------------------------------------------------------
+    bool bakePatchCache();
+
+    //----------------------------------------------------------------------
+    // 读取补丁缓存，无效时先从高度图烘焙；缓存无法写入或读回时在内存中构建补丁数据；在工作线程上执行
+    //----------------------------------------------------------------------
+    bool preparePatches();
+
+    //----------------------------------------------------------------------
+    // 实例化绘制要求整张地图的高度放进一张纹理，超过 GL_MAX_TEXTURE_SIZE 或者实例缓冲区创建失败时退回批量绘制
+    //----------------------------------------------------------------------
+    void checkRenderMode();
+
+    //----------------------------------------------------------------------
+    // 同步加载，返回时全部补丁已上传
+    //----------------------------------------------------------------------
+    void init();
+
+    //----------------------------------------------------------------------
+    // 异步加载：解码与构建在任务调度器上执行，完成后由主线程任务 uploadSlice 分批上传，
+    // 帧循环调用 JobSystem::runMainThreadJobs 执行；加载期间 render 只绘制已经上传的补丁
+    //----------------------------------------------------------------------
+    void initAsync();
+
+    //----------------------------------------------------------------------
+    // 用 GpuTerrain 生成的地形代替高度图，只用于实例化绘制，在 GL 线程上同步完成
+    // 着色器直接采样 terrain 的高度纹理，纹理大小必须等于 iNumPatchesPerSide * (iPatchSize - 1) + 1；
+    // 裁剪和等级选择需要的补丁高度范围与几何误差由读回的高度计算一次
+    // fHeightRange: 归一化高度 1 对应的世界高度
+    //----------------------------------------------------------------------
+    bool initFromGpuTerrain(const GpuTerrain &terrain, float fHeightRange);
+
+    //----------------------------------------------------------------------
+    // 主线程任务：上传一个时间片的补丁，未全部上传时重新提交自己，由 runMainThreadJobs 在预算内继续执行
+    // 有上传线程时一次全部交给上传线程，完成情况由主循环中的 UploadThread::poll 处理
+    //----------------------------------------------------------------------
+    void uploadSlice();
+
+    // 设置后台上传线程，为空或线程未启动时在 GL 线程上分批上传
+    void setUploadThread(UploadThread *pThread) { pUploadThread = pThread; }
+
+    //----------------------------------------------------------------------
+    // 取消加载并等待工作线程上的加载任务结束，退出前调用
+    // 正在烘焙时在当前补丁行完成后停止，不会等整张地图烘焙完
+    //----------------------------------------------------------------------
+    void waitLoading();
+
+    //----------------------------------------------------------------------
+    // 自检：在几个固定相机下分别在 CPU（selectPatchLODs）和 GpuCuller 上选择等级，读回 GPU 的结果逐补丁比较，
+    // 只有距离接近等级切换距离或包围盒贴着裁剪平面的补丁允许因浮点误差不同（相邻等级约束会把差异传给邻居），
+    // 并比较 GPU 的可见补丁数与绘制数。要求加载完成且当前线程有 GL 4.3 上下文，全部在容差内时返回 true
+    //----------------------------------------------------------------------
+    bool selfTestGpuCulling();
+
+    //----------------------------------------------------------------------
+    // 释放全部 GL 对象，要求上下文仍然有效：在 waitLoading 和停止上传线程之后、glfwTerminate 之前调用
+    // 环形缓冲区和 GpuCuller 的析构函数也会释放，但 LandScapeMap 是 main 的局部变量，析构时上下文已经销毁
+    //----------------------------------------------------------------------
+    void release();
+
+    LandLoadStage getLoadStage() const { return (LandLoadStage)iLoadStage.load(); }
+
+    // 实际使用的绘制方式，实例化绘制不可用时 init() 之后为批量绘制
+    LandRenderMode getRenderMode() const { return eRenderMode; }
+
+    // 整体加载进度 [0, 1]：解码、构建、上传三个阶段依次占 0.2、0.5、0.3
+    float getLoadProgress() const;
+
+    //----------------------------------------------------------------------
+    // 按屏幕空间误差选择补丁的等级：在投影误差不超过 fPixelError 的等级中取最粗的
+    // fPixelsPerUnit: 视口高度 / (2 * tan(fovY / 2))，距离为 1 时单位长度对应的像素数
+    //----------------------------------------------------------------------
+    int selectLOD(int iPatch, const glm::vec3 &eye_position, float fPixelsPerUnit) const;
+
+    //----------------------------------------------------------------------
+    // 在 CPU 上选择本帧的可见补丁与等级：四叉树视锥体裁剪、selectLOD、相邻补丁等级差不超过 1 的约束
+    // 结果写入 VisiblePatches 和 FrameLODs，不可见补丁的等级为 -1
+    //----------------------------------------------------------------------
+    void selectPatchLODs(const glm::vec3 &eye_position, const Frustum &frustum, float fPixelsPerUnit);
+
+    //----------------------------------------------------------------------
+    // 计算补丁在当前等级下的形变系数：距离接近切换到下一等级的距离时从 0 过渡到 1
+    // 在形变系数为 1 时补丁的形状与下一等级完全相同，切换时不会跳变
+    //----------------------------------------------------------------------
+    float computeMorph(int iPatch, int lod, const glm::vec3 &eye_position, float fPixelsPerUnit) const;
+
+    //----------------------------------------------------------------------
+    // 写入补丁的形变数据。边上的顶点与相邻补丁共用，需要两边一致：
+    // 相邻补丁同级时取两者形变系数的较大值；相邻补丁更细时它按本补丁的顶点缝合，边上不形变；
+    // 相邻补丁更粗时边中点已被接缝版本跳过，不影响
+    //----------------------------------------------------------------------
+    void updatePatchMorph(int iPatch);
+
+    //----------------------------------------------------------------------
+    // 绘制地形
+    // eye_position: 相机位置
+    // viewProjection: projection * view，用于视锥体裁剪
+    // fFovY: 垂直视场角（弧度）
+    // fViewportHeight: 视口高度（像素）
+    //----------------------------------------------------------------------
+    void render(glm::vec3 eye_position, const glm::mat4 &viewProjection, float fFovY, float fViewportHeight);
+
+    //----------------------------------------------------------------------
+    // 实例化绘制本帧的可见补丁：实例属性按接缝版本排序写入 InstanceRing，每个用到的接缝版本一次 glDrawElementsInstanced
+    //----------------------------------------------------------------------
+    void drawInstances();
+
+    //----------------------------------------------------------------------
+    // 查询高度图上某个采样点的世界高度，超出范围返回 0
+    //----------------------------------------------------------------------
+    float getHeight(int x, int y) const;
+
+    //----------------------------------------------------------------------
+    // 查询任意位置的世界高度（双线性插值）
+    //----------------------------------------------------------------------
+    float getHeight(float x, float y) const;
+
+    // 设置允许的屏幕空间误差（像素），越大使用的三角形越少
+    void setPixelError(float fPixels) { fPixelError = std::max(fPixels, 0.1f); }
+    float getPixelError() const { return fPixelError; }
+
+    // 开启几何形变，需要在 init() 之前设置
+    void setGeomorph(bool bEnable) { bGeomorph = bEnable; }
+
+    // 加载完成后在 GPU 上裁剪和选择等级（需要 GL 4.3 与批量绘制），需要在 init() 之前设置
+    void setGpuCulling(bool bEnable) { bGpuCulling = bEnable; }
+
+    // 是否保留每个补丁的 CPU 顶点副本，需要在 init() 之前设置
+    void setKeepPatchVertices(bool bKeep) { bKeepPatchVertices = bKeep; }
+
+    // 设置源高度图，补丁缓存放在同一目录下，需要在 init() 之前设置
+    void setHeightMapFile(const std::string &filename);
+
+    const std::string &getHeightMapFile() const { return strHeightMapFile; }
+
+    //----------------------------------------------------------------------
+    // 记录地形着色器的 uniform 位置
+    //----------------------------------------------------------------------
+    void setShader(unsigned int shaderProgram);
+
+    // 设置地形着色器的模型、观察和投影矩阵，要求着色器已经通过 glUseProgram 启用
+    void setMatrices(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // 地形着色器使用的顶点着色器，与 getRenderMode() 对应
+    const char *getVertexShaderSource() const;
+
+    // 地形着色器使用的片段着色器，GeoClipmap 也使用它
+    static const char *getFragmentShaderSource();
+
+    int m_iSize;
+
+private:
+    bool initIndices();
+    int buildQuadNode(int x0, int y0, int x1, int y1);
+    void cullQuadNode(int node, const Frustum &frustum, bool bInside);
+    void constrainPatchLODs(const std::vector<int> &visible, std::vector<int> &lods) const;
+    void setupVertexAttrib();
+    void writeHeight(unsigned char *dst, float z) const;
+    void setupVertexFormat();
+    void initPatch(int iPatch, float fMinHeight, float fMaxHeight);
+    static bool isCacheSectionValid(uint64_t offset, uint64_t length, uint64_t fileSize);
+    bool readPatchCache();
+    void initPatches(const float *bounds, const unsigned char *vertices);
+    bool loadHeightMap(bool bLoading);
+    void buildHeightStore(HeightMap &heightMap);
+    bool writePatchCache(const HeightMap &heightMap, uint64_t sourceSize, int64_t sourceTime);
+    bool buildPatchesInMemory(const HeightMap &heightMap);
+    void createPatchBuffers(const void *pVertices);
+    void createInstanceBuffers();
+    void uploadHeightRows(unsigned int uiTexture, int iBeginRow, int iEndRow) const;
+    unsigned int createPatchVAO(unsigned int VBO);
+    void finishUpload();
+    void initGpuCulling();
+    bool createGpuCuller();
+    bool uploadPatches(double fBudgetMs);
+    void submitPatchUploads();
+    void buildPatchVertices(const HeightMap &heightMap, int x, int y, float *patchHeights, float *morphTargets, float *bounds, unsigned char *dst);
+
+    LandPatch *LandPatches;           // 衍生的地形补丁
+    LandPatchIndex *LandPatchIndices; // 衍生的地形补丁索引，等级 l 接缝掩码 m 位于 l * LAND_STITCH_VARIANTS + m
+    int iPatchSize;                   // 衍生的地形大小
+    int iNumPatchesPerSide;           // 每边的补丁数量
+    int iMaxLOD;                      // 细节等级
+
+    LandRenderMode eRenderMode; // 绘制方式
+    unsigned int uiIndexEBO;    // 所有等级共享的索引缓冲区
+    unsigned int uiBatchVAO;    // 批量绘制时使用的 VAO
+    unsigned int uiBatchVBO;    // 批量绘制时存放所有补丁顶点的 VBO
+
+    // 实例化绘制：顶点只有补丁内坐标，所有补丁共用；每个可见补丁一个实例，高度在着色器中从高度纹理读取
+    unsigned int uiGridVBO;          // 补丁内坐标 (i, j)，每个分量一个字节
+    unsigned int uiInstanceVAO;      // 网格、实例属性与共享索引缓冲区
+    unsigned int uiHeightTex;        // R16 高度纹理，内容与 HeightStore 相同
+    bool bOwnsHeightTex;             // 高度纹理是否由本对象创建，使用 GpuTerrain 的纹理时为 false
+    RingBuffer InstanceRing;         // 每帧可见补丁的实例属性，按接缝版本分组连续存放
+    std::vector<int> FrameVariants;  // 当前帧每个可见补丁的接缝版本 lod * LAND_STITCH_VARIANTS + mask
+    std::vector<int> VariantStarts;  // 每个接缝版本的实例在本帧实例数组中的起点
+
+    LandVertexFormat eVertexFormat; // 顶点格式
+    int iComponentSize;             // 每个高度分量的字节数
+    int iVertexStride;              // 每个顶点的字节数，开启形变时为高度 + 形变目标高度两个分量
+    float fHeightScale;             // 顶点高度到世界高度的缩放，z = h * fHeightScale + fHeightBias
+    float fHeightBias;
+
+    // 整张地图共享的 16 位量化高度，上传 GPU 后 CPU 端的高度查询都从这里读取
+    std::vector<unsigned short> HeightStore;
+    int iStoreSize;    // 每边的采样数，等于 iNumPatchesPerSide * (iPatchSize - 1) + 1
+    float fStoreScale; // 世界高度 = 量化值 * fStoreScale + fStoreBias
+    float fStoreBias;
+    bool bKeepPatchVertices; // 是否保留每个补丁的 CPU 顶点副本，默认不保留以节省内存
+
+    std::string strHeightMapFile; // 源高度图
+    std::string strCacheFile;     // 烘焙的补丁缓存，默认为源高度图文件名 + ".patches"
+
+    // 异步加载状态，阶段与阶段内进度由工作线程写入、GL 线程读取
+    std::atomic<int> iLoadStage;              // LandLoadStage
+    std::atomic<float> fLoadProgress;         // 当前阶段的进度 [0, 1]
+    JobHandle LoadJob;                        // 读取或烘焙补丁缓存的任务
+    std::atomic<bool> bCancelLoad;            // 退出时取消加载，烘焙在每行补丁之后检查
+    MappedFile PatchCache;                    // 上传期间保持映射的补丁缓存
+    const unsigned char *pCacheVertices;      // 缓存中的顶点段或 PatchVertices，实例化绘制时为空
+    std::vector<unsigned char> PatchVertices; // 缓存不可用时在内存中构建的全部顶点，上传完成后释放
+    int iResidentPatches;                     // 已上传的补丁数，按补丁编号顺序上传
+    UploadThread *pUploadThread;              // 后台上传线程，为空时在 GL 线程上上传
+
+    // 地形着色器的 uniform 位置
+    int iPatchSizeLoc;
+    int iPatchesPerSideLoc;
+    int iVertexOffsetLoc;
+    int iHeightScaleLoc;
+    int iHeightBiasLoc;
+    int iMaxLODLoc;
+    int iGeomorphLoc;
+    int iPatchDataLoc;
+    int iHeightMapLoc;
+    int iModelLoc;
+    int iViewLoc;
+    int iProjectionLoc;
+
+    // 几何形变：顶点携带下一等级的目标高度，着色器按补丁的形变系数混合
+    bool bGeomorph;
+    float fMorphRange;                    // 切换到下一等级前多大比例的距离区间内进行形变
+    unsigned int uiPatchDataTBO;          // 每个补丁的等级与形变系数（纹理缓冲区）
+    unsigned int uiPatchDataTex;
+    std::vector<glm::vec4> PatchMorphData; // 每个补丁两个 texel：(等级, 形变系数, 0, 0)，(左, 上, 右, 下 边上的形变系数)
+    std::vector<float> FrameMorphs;        // 当前帧每个补丁的形变系数
+    RingBuffer MorphRing;                  // 每帧的形变数据，未创建时直接更新 uiPatchDataTBO
+    size_t uiTexBufferAlignment;           // 纹理缓冲区子范围起点的对齐
+    bool bMorphRingUsed;                   // 本帧是否调用了 MorphRing.beginFrame，帧末需要 endFrame
+
+    // GPU 裁剪：加载完成后由计算着色器选择等级并生成间接绘制命令，只用于批量绘制
+    bool bGpuCulling;
+    GpuPatchCuller GpuCuller;
+
+    std::vector<LandQuadNode> QuadTree; // 补丁四叉树，0 号为根节点
+    std::vector<int> VisiblePatches;    // 当前帧视锥体内的补丁
+    std::vector<int> FrameLODs;         // 当前帧每个补丁的等级，不可见为 -1
+
+    std::vector<float> PatchErrors; // 每个补丁每个等级的几何误差，补丁 p 等级 l 位于 p * (iMaxLOD + 1) + l
+    float fPixelError;              // 允许的屏幕空间误差（像素）
+
+    // 批量绘制时每帧的绘制参数
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void *> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+};
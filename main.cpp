@@ -2,326 +2,26 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "terrain.h"
 #include "geomipmapping.h"
-
-#include "tiffio.h"
-
-class HeightMap
-{
-public:
-    HeightMap(const char *filename)
-    {
-        TIFF *tif = TIFFOpen(filename, "r");
-        if (tif == NULL)
-        {
-            std::cerr << "Error opening TIFF file: " << filename << std::endl;
-            return;
-        }
-        uint16_t bitsPerSample;
-        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &Width);
-        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &Height);
-        TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
-
-        HeightData.resize(Width * Height);
-        if (bitsPerSample == 32)
-        {
-            float *buf = (float *)_TIFFmalloc(Width * sizeof(float));
-            for (uint32_t row = 0; row < Height; row++)
-            {
-                TIFFReadScanline(tif, buf, row);
-                // 示例：打印第一行前5个像素
-                for (uint32_t col = 0; col < Width; col++)
-                {
-                    // 处理每个像素的浮点值
-                    HeightData[row * Width + col] = buf[col];
-                }
-            }
-            _TIFFfree(buf);
-        }
-        else
-        {
-            printf("不支持位深: %u\n", bitsPerSample);
-        }
-
-        TIFFClose(tif);
-    }
-
-    ~HeightMap()
-    {
-        HeightData.clear();
-    }
-
-    float getHeight(int x, int y)
-    {
-        if (x < 0 || x >= Width || y < 0 || y >= Height)
-        {
-            return 0.0f; // 返回默认高度
-        }
-        return HeightData[y * Width + x];
-    }
-
-private:
-    uint32_t Width;
-    uint32_t Height;
-    std::vector<float> HeightData;
-};
-
-struct LandPatch
-{
-    unsigned int VAO; // 顶点数组对象
-    float *vertices;  // 补丁顶点信息;
-    int iLOD;         // 当前补丁应该使用的等级，与相机距离有关
-    float fDistance;  // 距离相机的距离
-    float ix;
-    float iy;
-    float imin_x;
-    float imin_y;
-    float imax_x;
-    float imax_y;
-};
-
-struct LandPatchIndex
-{
-    unsigned int *indices; // 衍生的地形补丁索引
-    int indices_count;     // 衍生的地形补丁索引数量
-    int iLOD;              // 当前补丁应该使用的等级，与相机距离有关
-};
-
-class LandScapeMap
-{
-private:
-    LandPatch *LandPatches;           // 衍生的地形补丁
-    LandPatchIndex *LandPatchIndices; // 衍生的地形补丁索引
-    int iPatchSize;                   // 衍生的地形大小
-    int iNumPatchesPerSide;           // 每边的补丁数量
-    int iMaxLOD;                      // 细节等级
-
-public:
-    void init()
-    {
-
-        HeightMap heightMap("heightmap.tif");
-        // 读取高度图数据
-
-        int iLOD = 0;
-        int iDivisor = iPatchSize - 1;
-        while (iDivisor > 2)
-        {
-            iDivisor = iDivisor >> 1;
-            iLOD++;
-        }
-        iMaxLOD = iLOD;
-        int half = iPatchSize / 2;
-        // 计算顶点数量
-        for (int32_t y = 0; y < iNumPatchesPerSide; y++)
-        {
-            for (int32_t x = 0; x < iNumPatchesPerSide; x++)
-            {
-                LandPatches[y * iNumPatchesPerSide + x].iLOD = iMaxLOD;
-                LandPatches[y * iNumPatchesPerSide + x].fDistance = 0.0f;
-                LandPatches[y * iNumPatchesPerSide + x].vertices = new float[iPatchSize * iPatchSize * 3];
-                float i_minx = std::numeric_limits<float>::max();
-                float i_miny = std::numeric_limits<float>::max();
-                float i_maxx = std::numeric_limits<float>::min();
-                float i_maxy = std::numeric_limits<float>::min();
-                float dx = 0;
-                float dy = 0;
-                // 计算补丁的顶点坐标
-                for (int32_t j = 0; j < iPatchSize; j++)
-                {
-                    for (int32_t i = 0; i < iPatchSize; i++)
-                    {
-                        dx = x * (iPatchSize - 1) + i;
-                        dy = y * (iPatchSize - 1) + j;
-                        // 坐标 x 为 y*iNumPatchesPerSide*iPatchSize
-                        LandPatches[y * iNumPatchesPerSide + x].vertices[j * iPatchSize * 3 + i * 3] = dx;
-                        LandPatches[y * iNumPatchesPerSide + x].vertices[j * iPatchSize * 3 + i * 3 + 1] = dy;
-                        LandPatches[y * iNumPatchesPerSide + x].vertices[j * iPatchSize * 3 + i * 3 + 2] = 4000 * heightMap.getHeight(dx, dy); // heightMap.getHeight(dx, dy);
-                        // std::cout << "vertices x:" << x * (iPatchSize - 1) + i << ", y:" << y * (iPatchSize - 1) + j << std::endl;
-                        if (dx < i_minx)
-                        {
-                            i_minx = dx;
-                        }
-                        if (dy < i_miny)
-                        {
-                            i_miny = dy;
-                        }
-                        if (dx > i_maxx)
-                        {
-                            i_maxx = dx;
-                        }
-                        if (dy > i_maxy)
-                        {
-                            i_maxy = dy;
-                        }
-                    }
-                }
-                LandPatches[y * iNumPatchesPerSide + x].ix = LandPatches[y * iNumPatchesPerSide + x].vertices[(half * iPatchSize + half) * 3];
-                LandPatches[y * iNumPatchesPerSide + x].iy = LandPatches[y * iNumPatchesPerSide + x].vertices[(half * iPatchSize + half) * 3 + 1];
-                LandPatches[y * iNumPatchesPerSide + x].imin_x = i_minx;
-                LandPatches[y * iNumPatchesPerSide + x].imin_y = i_miny;
-                LandPatches[y * iNumPatchesPerSide + x].imax_x = i_maxx;
-                LandPatches[y * iNumPatchesPerSide + x].imax_y = i_maxy;
-
-                unsigned int VAO, VBO;
-                // 生成 VAO、VBO
-                glGenVertexArrays(1, &VAO);
-                glGenBuffers(1, &VBO);
-
-                glBindVertexArray(VAO);
-                glBindBuffer(GL_ARRAY_BUFFER, VBO);
-                glBufferData(GL_ARRAY_BUFFER, sizeof(float) * iPatchSize * iPatchSize * 3, LandPatches[y * iNumPatchesPerSide + x].vertices, GL_STATIC_DRAW);
-
-                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-                glEnableVertexAttribArray(0);
-
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
-                glBindVertexArray(0);
-                LandPatches[y * iNumPatchesPerSide + x].VAO = VAO; // 保存 VAO
-            }
-        }
-
-        LandPatchIndices = new LandPatchIndex[iMaxLOD];
-        for (int32_t c_lod = 0; c_lod <= iMaxLOD; c_lod++)
-        {
-            int ebo_per_patch = (iPatchSize - 1);
-            int step = 1;
-            int lod = c_lod;
-            while (lod > -1)
-            {
-                lod--;
-                ebo_per_patch = ebo_per_patch >> 1;
-                step = step << 1;
-            }
-            step = step >> 1;
-
-            LandPatchIndices[c_lod].indices_count = ebo_per_patch * ebo_per_patch;
-            LandPatchIndices[c_lod].indices = new unsigned int[ebo_per_patch * ebo_per_patch];
-            LandPatchIndices[c_lod].iLOD = c_lod;
-
-            unsigned int *indices = new unsigned int[10];
-            // 构建顶点索引;
-            for (int32_t j = 0; j < ebo_per_patch; j++)
-            {
-                for (int32_t i = 0; i < ebo_per_patch; i++)
-                {
-                    indices[0] = (j * (step * 2) + 1 * step) * iPatchSize + (i * (step * 2) + 1 * step);
-                    indices[1] = (j * (step * 2) + 2 * step) * iPatchSize + i * (step * 2);
-                    indices[2] = (j * (step * 2) + 1 * step) * iPatchSize + i * (step * 2);
-                    indices[3] = (j * (step * 2)) * iPatchSize + i * (step * 2);
-                    indices[4] = ((j * (step * 2)) * iPatchSize + (i * (step * 2) + 1 * step));
-                    indices[5] = ((j * (step * 2)) * iPatchSize + (i * (step * 2) + 2 * step));
-                    indices[6] = ((j * (step * 2) + 1 * step) * iPatchSize + (i * (step * 2) + 2 * step));
-                    indices[7] = ((j * (step * 2) + 2 * step) * iPatchSize + (i * (step * 2) + 2 * step));
-                    indices[8] = ((j * (step * 2) + 2 * step) * iPatchSize + (i * (step * 2) + 1 * step));
-                    indices[9] = ((j * (step * 2) + 2 * step) * iPatchSize + i * (step * 2));
-
-                    // std::cout << "indices " << indices[0] << ", " << indices[1] << ", " << indices[2] << ", " << indices[3] << ", " << indices[4] << ", " << indices[5] << ", " << indices[6] << ", " << indices[7] << ", " << indices[8] << ", " << indices[9] << std::endl;
-                    //  生成索引缓冲区
-                    unsigned int EBO;
-                    glGenBuffers(1, &EBO);
-                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * 10, indices, GL_STATIC_DRAW);
-                    LandPatchIndices[c_lod].indices[j * ebo_per_patch + i] = EBO; // 保存索引缓冲区
-                }
-            }
-            delete[] indices; // 释放索引缓冲区
-        }
-    }
-
-    void render(glm::vec3 eye_position, glm::vec3 target = glm::vec3(0, 0, 0), float resolution = 0)
-    {
-        // float fDistance = 0.0f;                                  // 平均距离，
-        // float min_distance = std::numeric_limits<double>::max(); // 距离最小值
-        // float max_distance = std::numeric_limits<double>::min(); // 距离最大值
-        // for (int32_t y = 0; y < iNumPatchesPerSide; y++)
-        // {
-        //     for (int32_t x = 0; x < iNumPatchesPerSide; x++)
-        //     {
-        //         float d = glm::distance(eye_position, glm::vec3(LandPatches[y * iNumPatchesPerSide + x].ix, LandPatches[y * iNumPatchesPerSide + x].iy, 0.0f));
-        //         LandPatches[y * iNumPatchesPerSide + x].fDistance = d;
-        //         fDistance += d;
-        //         if (d < min_distance)
-        //         {
-        //             min_distance = d;
-        //         }
-        //         if (d > max_distance)
-        //         {
-        //             max_distance = d;
-        //         }
-        //     }
-        // }
-        // fDistance /= (iNumPatchesPerSide * iNumPatchesPerSide);
-        // std::cout << "average distance:" << fDistance << std::endl;
-        // std::cout << "min distance:" << min_distance << std::endl;
-        // std::cout << "max distance:" << max_distance << std::endl;
-
-        // float distance_sep = (max_distance - min_distance) / (iMaxLOD + 1);
-
-        // 初始 Lod。中间区域最小 lod;
-        // int i_lod = 0;
-        // int i_ = 0.02 / resolution;
-        // while (i_ > 1)
-        // {
-        //     i_ = i_ >> 1;
-        //     i_lod++;
-        // }
-
-        for (int32_t y = 0; y < iNumPatchesPerSide; y++)
-        {
-            for (int32_t x = 0; x < iNumPatchesPerSide; x++)
-            {
-                // 绑定 VAO
-                glBindVertexArray(LandPatches[y * iNumPatchesPerSide + x].VAO);
-                // 绘制补丁
-
-                float d = glm::distance(glm::vec3(eye_position.x, eye_position.y, 0), glm::vec3(LandPatches[y * iNumPatchesPerSide + x].ix, LandPatches[y * iNumPatchesPerSide + x].iy, 0.0f));
-                // float targetDistance = glm::distance(target, glm::vec3(LandPatches[y * iNumPatchesPerSide + x].ix, LandPatches[y * iNumPatchesPerSide + x].iy, 0.0f));
-                // LandPatches[y * iNumPatchesPerSide + x].fDistance = d;
-                // float lod_distance = d * resolution; // 计算当前补丁的距离
-
-                // if (lod_distance > 2.0f)
-                // {
-                //     continue;
-                // }
-                // int lod = (d * resolution) / 0.5 + i_lod;
-                int lod =  d / 300;
-
-                // std::cout << "lod:" << lod << std::endl;
-                if (lod > iMaxLOD)
-                {
-                    continue;
-                    lod = iMaxLOD;
-                }
-                // int lod=0;
-                LandPatches[y * iNumPatchesPerSide + x].iLOD = lod;
-                int size = LandPatchIndices[lod].indices_count;
-                for (int32_t i = 0; i < size; i++)
-                {
-                    // 绑定索引缓冲区
-                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, LandPatchIndices[lod].indices[i]);
-                    // 绘制补丁
-                    glDrawElements(GL_TRIANGLE_FAN, 10, GL_UNSIGNED_INT, 0);
-                }
-            }
-        }
-    }
-
-    int m_iSize;
-
-public:
-    LandScapeMap(int m_iSize, int iPatchSize)
-    {
-        this->iPatchSize = iPatchSize;
-        this->m_iSize = m_iSize;
-        iNumPatchesPerSide = m_iSize / (iPatchSize - 1);
-        LandPatches = new LandPatch[iNumPatchesPerSide * iNumPatchesPerSide];
-    }
-};
+#include "heightmap.h"
+#include "jobsystem.h"
+#include "uploadthread.h"
+#include "gputerrain.h"
+#include "landscape.h"
+#include "clipmap.h"
+#include "imgui.h"
+#include "imgui_impl_glfw.h"
+#include "imgui_impl_opengl3.h"
 
 class Mesh
 {
@@ -454,31 +154,6 @@ private:
     std::vector<unsigned int> EBOS;
 };
 
-// 顶点着色器
-const char *vertexShaderSource = R"(
-#version 330 core
-layout(location = 0) in vec3 aPos;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
-)";
-
-// 片段着色器
-const char *fragmentShaderSource = R"(
-#version 330 core
-out vec4 FragColor;
-
-void main()
-{
-    FragColor = vec4(1.0, 0.0, 1.0, 1.0); // 白色
-}
-)";
 
 // 相机类
 class Camera
@@ -599,16 +274,129 @@ void scrollCallback(GLFWwindow *window, double xOffset, double yOffset)
     camera.position += camera.front * cameraSpeed;
 }
 
+// 视口大小
+int iViewportWidth = 800;
+int iViewportHeight = 600;
+
 void framebufferSizeCallback(GLFWwindow *window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    iViewportWidth = width;
+    iViewportHeight = height;
 }
 
 // 高度图分辨率
 int m_iSize; // the size of the heightmap, must be a power of two
 
-int main()
+//----------------------------------------------------------------------
+// 在隐藏窗口的 GL 4.3 上下文中执行自检，通过时返回 0
+//----------------------------------------------------------------------
+static int RunSelfTest(const std::function<bool()> &test)
 {
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "Self test", nullptr, nullptr);
+    if (!window)
+    {
+        std::cerr << "Failed to create an OpenGL 4.3 context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    bool bPassed = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) && test();
+    glfwTerminate();
+    return bPassed ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    // 在主线程上创建任务调度器，主线程队列中的任务由帧循环执行
+    JobSystem &jobSystem = JobSystem::instance();
+
+    // 命令行选项可以组合，例如 YK --instanced --gpu-terrain
+    bool bBake = false;
+    bool bSelfTestGpuTerrain = false;
+    bool bSelfTestGpuCull = false;
+    bool bInstanced = false;
+    bool bGpuCull = false;
+    bool bGpuTerrain = false;
+    bool bClipmap = false;
+    struct CommandLineOption
+    {
+        const char *name;
+        bool *pFlag;
+    };
+    const CommandLineOption options[] = {
+        {"--bake", &bBake},
+        {"--selftest-gpu-terrain", &bSelfTestGpuTerrain},
+        {"--selftest-gpu-cull", &bSelfTestGpuCull},
+        {"--instanced", &bInstanced},
+        {"--gpu-cull", &bGpuCull},
+        {"--gpu-terrain", &bGpuTerrain},
+        {"--clipmap", &bClipmap},
+    };
+    for (int i = 1; i < argc; i++)
+    {
+        bool bKnown = false;
+        for (const CommandLineOption &option : options)
+        {
+            if (strcmp(argv[i], option.name) == 0)
+            {
+                *option.pFlag = true;
+                bKnown = true;
+            }
+        }
+        if (!bKnown)
+        {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+        }
+    }
+
+    // YK --bake：只烘焙补丁缓存，不创建窗口
+    if (bBake)
+    {
+        LandScapeMap landScapeMap(8193, 65);
+        landScapeMap.setGeomorph(true);
+        return landScapeMap.bakePatchCache() ? 0 : -1;
+    }
+
+    // 自检在隐藏窗口中执行，不进入帧循环，同时指定时依次执行
+    if (bSelfTestGpuTerrain || bSelfTestGpuCull)
+    {
+        int iResult = 0;
+        // YK --selftest-gpu-terrain：比较 GpuTerrain 与 CTERRAIN 用同一种子生成的地形
+        if (bSelfTestGpuTerrain && RunSelfTest([]
+                                               { return GpuTerrain::selfTest(); }) != 0)
+        {
+            iResult = -1;
+        }
+        // YK --selftest-gpu-cull：在 GpuTerrain 生成的 1025 x 1025、高差 200 的地形上比较 CPU 与 GPU 的裁剪和等级选择
+        if (bSelfTestGpuCull && RunSelfTest([]
+                                            {
+            GpuTerrain terrain;
+            LandScapeMap landScapeMap(1025, 65, LAND_RENDER_INSTANCED);
+            landScapeMap.setGeomorph(true);
+            bool bPassed = terrain.init(1025);
+            if (bPassed)
+            {
+                terrain.generateNoise(CTERRAIN::MakeNoiseOctaves(8, 4.0f), 1);
+                bPassed = landScapeMap.initFromGpuTerrain(terrain, 200.0f) && landScapeMap.selfTestGpuCulling();
+            }
+            landScapeMap.release();
+            terrain.release();
+            return bPassed; }) != 0)
+        {
+            iResult = -1;
+        }
+        return iResult;
+    }
 
     // CGEOMIPMAPPING terrain;
     // terrain.m_iSize=257;
@@ -624,12 +412,19 @@ int main()
         return -1;
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // 优先创建 4.3 上下文以使用计算着色器（GpuTerrain），不支持时退回 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     GLFWwindow *window = glfwCreateWindow(800, 600, "Camera with Mouse Control", nullptr, nullptr);
     if (!window)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(800, 600, "Camera with Mouse Control", nullptr, nullptr);
+    }
+    if (!window)
     {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -663,17 +458,69 @@ int main()
         return -1;
     }
 
+    // 加载进度显示在 ImGui 窗口中；ImGui 的回调会转发给上面设置的回调
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+
     // Mesh mesh(b_vertices, b_indices);
-    LandScapeMap landScapeMap(8193, 65);
-    landScapeMap.init();
+    // 地形在后台加载，窗口立即开始绘制，补丁上传后逐步出现
+    // YK --instanced：所有补丁共用一个网格实例化绘制，高度从高度纹理读取
+    // YK --gpu-terrain：地形由计算着色器生成，实例化绘制直接采样生成的高度纹理，不读取高度图
+    bInstanced = bInstanced || bGpuTerrain;
+    int iMapSize = bGpuTerrain ? 4097 : 8193;
+    LandScapeMap landScapeMap(iMapSize, 65, bInstanced ? LAND_RENDER_INSTANCED : LAND_RENDER_BATCHED);
+    landScapeMap.setGeomorph(true);
+    // YK --gpu-cull：加载完成后改为 GPU 裁剪与间接绘制
+    if (bGpuCull)
+    {
+        landScapeMap.setGpuCulling(true);
+    }
+    // 顶点由共享上下文的后台线程上传，创建失败时退回到每帧分批上传
+    UploadThread uploadThread;
+    if (uploadThread.start(window))
+    {
+        landScapeMap.setUploadThread(&uploadThread);
+    }
+
+    // YK --clipmap：改用几何裁剪图绘制，高度图在工作线程上读取，读取完成后才创建裁剪图
+    GeoClipmap clipmap;
+    std::unique_ptr<HeightMap> pClipmapHeights;
+    JobHandle ClipmapLoad;
+    GpuTerrain gpuTerrain;
+    if (bClipmap)
+    {
+        std::string strHeightMapFile = landScapeMap.getHeightMapFile();
+        ClipmapLoad = jobSystem.submit([&pClipmapHeights, strHeightMapFile]
+                                       { pClipmapHeights.reset(new HeightMap(strHeightMapFile.c_str())); });
+    }
+    else if (bGpuTerrain)
+    {
+        if (gpuTerrain.init(iMapSize))
+        {
+            gpuTerrain.generateNoise(CTERRAIN::MakeNoiseOctaves(10, 4.0f), 1);
+        }
+        landScapeMap.initFromGpuTerrain(gpuTerrain, 4000.0f);
+    }
+    else
+    {
+        landScapeMap.initAsync();
+    }
 
     // 创建和编译着色器
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+    const char *vertexSource = landScapeMap.getVertexShaderSource();
+    if (bClipmap)
+    {
+        vertexSource = GeoClipmap::getVertexShaderSource();
+    }
+    glShaderSource(vertexShader, 1, &vertexSource, nullptr);
     glCompileShader(vertexShader);
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+    const char *fragmentSource = LandScapeMap::getFragmentShaderSource();
+    glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
     glCompileShader(fragmentShader);
 
     unsigned int shaderProgram = glCreateProgram();
@@ -684,6 +531,9 @@ int main()
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
+    landScapeMap.setShader(shaderProgram);
+    clipmap.setShader(shaderProgram);
+
     // 设置线框模式
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -693,19 +543,19 @@ int main()
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // 执行提交到主线程的 GL 任务（分批上传补丁），每帧最多 4 毫秒；使用上传线程时只检查已完成的上传
+        jobSystem.runMainThreadJobs(4.0);
+        uploadThread.poll();
+
         glUseProgram(shaderProgram);
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), 800.0f / 600.0f, 0.1f, 10000.0f);
+        float aspect = iViewportHeight > 0 ? (float)iViewportWidth / iViewportHeight : 1.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), aspect, 0.1f, 10000.0f);
         glm::mat4 view = camera.getViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
 
-        unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-        unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-        unsigned int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        // uniform 位置在 setShader 中查询一次；裁剪图与地形共用同一个着色器程序
+        landScapeMap.setMatrices(model, view, projection);
 
         // float l = camera.position.z / camera.front.z;
         // glm::vec4 p_o = projection * view * glm::vec4(0, 0, 0, 1.0f);
@@ -716,7 +566,29 @@ int main()
         // float px = glm::distance(glm::vec3(p_o.x, p_o.y, p_o.z), glm::vec3(p_o1.x, p_o1.y, p_o1.z));
         // std::cout << "distance:" << px << std::endl;
         // 控制最小网格密度为 0.02
-        landScapeMap.render(camera.position);
+        if (bClipmap)
+        {
+            if (!clipmap.isReady() && JobSystem::isDone(ClipmapLoad) && pClipmapHeights && pClipmapHeights->isLoaded())
+            {
+                // 8 层，每层 255 x 255 个顶点，最粗一层覆盖 32512 x 32512；高度按需从高度图点采样
+                const HeightMap *pHeights = pClipmapHeights.get();
+                clipmap.init(8, 64, [pHeights](int iLevel, int x0, int y0, int iWidth, int iHeight, float *dst)
+                             {
+                    int iStep = 1 << iLevel;
+                    for (int j = 0; j < iHeight; j++)
+                    {
+                        for (int i = 0; i < iWidth; i++)
+                        {
+                            dst[(size_t)j * iWidth + i] = 4000 * pHeights->getHeight((x0 + i) * iStep, (y0 + j) * iStep);
+                        }
+                    } });
+            }
+            clipmap.render(camera.position, projection * view);
+        }
+        else
+        {
+            landScapeMap.render(camera.position, projection * view, glm::radians(camera.zoom), (float)iViewportHeight);
+        }
         // landScapeMap.render(camera.position);
         //  glBindVertexArray(mesh.getVAO());
 
@@ -729,10 +601,50 @@ int main()
 
         glBindVertexArray(0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // 解绑索引缓冲区
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+        LandLoadStage eStage = landScapeMap.getLoadStage();
+        if (bClipmap)
+        {
+            if (!clipmap.isReady())
+            {
+                // 读取任务结束但高度图无效时不会再创建裁剪图，显示失败
+                bool bFailed = JobSystem::isDone(ClipmapLoad) && !(pClipmapHeights && pClipmapHeights->isLoaded());
+                ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always);
+                ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings);
+                ImGui::Text("%s", bFailed ? "Failed to load height map" : "Decoding height map");
+                ImGui::End();
+            }
+        }
+        else if (eStage != LAND_LOAD_READY)
+        {
+            static const char *stageNames[] = {"Waiting", "Decoding", "Building patches", "Uploading", "Ready", "Failed"};
+            ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always);
+            ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings);
+            ImGui::Text("%s", stageNames[eStage]);
+            ImGui::ProgressBar(landScapeMap.getLoadProgress(), ImVec2(240.0f, 0.0f));
+            ImGui::End();
+        }
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    landScapeMap.waitLoading();
+    jobSystem.wait(ClipmapLoad);
+    uploadThread.stop();
+    // GL 对象在上下文销毁前释放
+    landScapeMap.release();
+    clipmap.release();
+    gpuTerrain.release();
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "patchcache.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool GetFileStamp(const char *filename, uint64_t &size, int64_t &mtime)
+{
+#ifdef _WIN32
+    // 文件时间为 1601 年起的 100 纳秒数，换算到 1970 年起的纳秒数，与其他平台一致
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+    size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    int64_t fileTime = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+    mtime = (fileTime - 116444736000000000LL) * 100;
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0)
+    {
+        return false;
+    }
+    size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+bool SeekFile(FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+MappedFile::MappedFile()
+    : pData(nullptr), uiSize(0)
+{
+#ifdef _WIN32
+    hFile = INVALID_HANDLE_VALUE;
+    hMapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+//----------------------------------------------------------------------
+// 映射文件，失败时返回 false（文件不存在是正常情况，不输出错误）
+//----------------------------------------------------------------------
+bool MappedFile::open(const char *filename)
+{
+    close();
+#ifdef _WIN32
+    hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL)
+    {
+        close();
+        return false;
+    }
+    pData = (const unsigned char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (pData == nullptr)
+    {
+        close();
+        return false;
+    }
+    uiSize = (size_t)size.QuadPart;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后文件描述符不再需要
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+    // 顶点段会被整段顺序读取
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    pData = (const unsigned char *)p;
+    uiSize = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (pData != nullptr)
+    {
+        UnmapViewOfFile(pData);
+    }
+    if (hMapping != NULL)
+    {
+        CloseHandle(hMapping);
+    }
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    hFile = INVALID_HANDLE_VALUE;
+    hMapping = NULL;
+#else
+    if (pData != nullptr)
+    {
+        munmap((void *)pData, uiSize);
+    }
+#endif
+    pData = nullptr;
+    uiSize = 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+//----------------------------------------------------------------------
+// 烘焙的补丁缓存文件
+// 布局：文件头 | 补丁高度范围 | 各等级几何误差 | 共享量化高度 | 全部补丁顶点（实例化绘制烘焙的缓存没有）
+// 每一段都从页边界开始，运行时映射整个文件后可以直接把顶点段交给 glBufferData
+//----------------------------------------------------------------------
+#define PATCH_CACHE_MAGIC "YKPATCH"
+#define PATCH_CACHE_VERSION 2
+#define PATCH_CACHE_ALIGNMENT 4096
+
+struct PatchCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+
+    // 源高度图的大小与修改时间（纳秒），任一变化时缓存失效
+    uint64_t sourceSize;
+    int64_t sourceTime;
+
+    // 生成缓存时的地形参数，与运行时不一致时缓存失效
+    int32_t iPatchSize;
+    int32_t iNumPatchesPerSide;
+    int32_t iMaxLOD;
+    int32_t iVertexFormat;
+    int32_t iGeomorph;
+    int32_t iVertexStride;
+    int32_t iStoreSize;
+    float fHeightScale;
+    float fHeightBias;
+    float fStoreScale;
+    float fStoreBias;
+
+    // 各段在文件中的偏移（字节）
+    uint64_t boundsOffset;   // 每个补丁 2 个 float：最小高度、最大高度
+    uint64_t errorsOffset;   // 每个补丁 iMaxLOD + 1 个 float
+    uint64_t storeOffset;    // iStoreSize * iStoreSize 个 unsigned short
+    uint64_t verticesOffset; // 补丁 p 的顶点位于 verticesOffset + p * iPatchSize * iPatchSize * iVertexStride，没有顶点段时为 0
+    uint64_t fileSize;
+};
+
+// 向上对齐到页边界
+inline uint64_t AlignPatchCache(uint64_t offset)
+{
+    return (offset + PATCH_CACHE_ALIGNMENT - 1) / PATCH_CACHE_ALIGNMENT * PATCH_CACHE_ALIGNMENT;
+}
+
+// 获取文件大小与修改时间，修改时间以纳秒为单位，精度取决于平台和文件系统
+bool GetFileStamp(const char *filename, uint64_t &size, int64_t &mtime);
+
+// 支持超过 2GB 的文件内定位
+bool SeekFile(FILE *file, uint64_t offset);
+
+//----------------------------------------------------------------------
+// 只读映射整个文件
+//----------------------------------------------------------------------
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *filename);
+    void close();
+
+    const unsigned char *data() const { return pData; }
+    size_t size() const { return uiSize; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const unsigned char *pData;
+    size_t uiSize;
+#ifdef _WIN32
+    void *hFile;
+    void *hMapping;
+#endif
+};
@@ -0,0 +1,158 @@
+#include "ringbuffer.h"
+#include <iostream>
+
+RingBuffer::RingBuffer()
+    : eTarget(GL_ARRAY_BUFFER), uiBuffer(0), uiFrameSize(0), iFrames(0), iFrame(0), uiUsed(0), bPersistent(false), pMapped(nullptr)
+{
+    for (int i = 0; i < MAX_FRAMES; i++)
+    {
+        fences[i] = nullptr;
+    }
+}
+
+RingBuffer::~RingBuffer()
+{
+    release();
+}
+
+bool RingBuffer::init(GLenum eTarget, size_t uiFrameSize, int iFrames, bool bAllowPersistent)
+{
+    release();
+    if (iFrames < 1 || iFrames > MAX_FRAMES || uiFrameSize == 0)
+    {
+        std::cerr << "Invalid ring buffer size: " << iFrames << " x " << uiFrameSize << std::endl;
+        return false;
+    }
+    this->eTarget = eTarget;
+    this->uiFrameSize = uiFrameSize;
+    this->iFrames = iFrames;
+    // 第一次 beginFrame 切换到 0 号段
+    iFrame = iFrames - 1;
+    uiUsed = 0;
+    bPersistent = bAllowPersistent && (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+
+    glGenBuffers(1, &uiBuffer);
+    glBindBuffer(eTarget, uiBuffer);
+    GLsizeiptr size = (GLsizeiptr)(uiFrameSize * iFrames);
+    if (bPersistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(eTarget, size, nullptr, flags);
+        pMapped = (unsigned char *)glMapBufferRange(eTarget, 0, size, flags);
+        if (pMapped == nullptr)
+        {
+            // 不可变存储不能重新分配，换一个缓冲区改为每帧映射
+            std::cerr << "Failed to map ring buffer persistently, mapping every frame" << std::endl;
+            glBindBuffer(eTarget, 0);
+            glDeleteBuffers(1, &uiBuffer);
+            bPersistent = false;
+            glGenBuffers(1, &uiBuffer);
+            glBindBuffer(eTarget, uiBuffer);
+        }
+    }
+    if (!bPersistent)
+    {
+        glBufferData(eTarget, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(eTarget, 0);
+    return true;
+}
+
+void RingBuffer::release()
+{
+    for (int i = 0; i < MAX_FRAMES; i++)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+    if (uiBuffer)
+    {
+        if (pMapped)
+        {
+            glBindBuffer(eTarget, uiBuffer);
+            glUnmapBuffer(eTarget);
+            glBindBuffer(eTarget, 0);
+        }
+        glDeleteBuffers(1, &uiBuffer);
+        uiBuffer = 0;
+    }
+    pMapped = nullptr;
+    iFrames = 0;
+}
+
+void RingBuffer::beginFrame()
+{
+    if (!uiBuffer)
+    {
+        return;
+    }
+    // 上一帧没有调用 flush 或 endFrame 时先取消它的映射，否则缓冲区仍处于映射状态，本帧映射会失败
+    flush();
+    iFrame = (iFrame + 1) % iFrames;
+    uiUsed = 0;
+    // 等待 GPU 用完这一段；通常已经触发，只有 CPU 领先 iFrames - 1 帧以上时才会阻塞
+    if (fences[iFrame])
+    {
+        GLenum eResult = glClientWaitSync(fences[iFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (eResult == GL_TIMEOUT_EXPIRED)
+        {
+            eResult = glClientWaitSync(fences[iFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fences[iFrame]);
+        fences[iFrame] = nullptr;
+    }
+    if (!bPersistent)
+    {
+        // 栅栏已经保证 GPU 不再读取这一段，映射时不需要驱动再同步
+        glBindBuffer(eTarget, uiBuffer);
+        pMapped = (unsigned char *)glMapBufferRange(eTarget, (GLintptr)(uiFrameSize * iFrame), (GLsizeiptr)uiFrameSize,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(eTarget, 0);
+    }
+}
+
+void *RingBuffer::allocate(size_t uiSize, size_t uiAlignment, size_t &offset)
+{
+    if (pMapped == nullptr)
+    {
+        return nullptr;
+    }
+    size_t uiBase = uiFrameSize * iFrame;
+    // 对齐的是整个缓冲区中的偏移
+    size_t uiStart = uiBase + uiUsed;
+    if (uiAlignment > 1)
+    {
+        uiStart = (uiStart + uiAlignment - 1) / uiAlignment * uiAlignment;
+    }
+    if (uiStart + uiSize > uiBase + uiFrameSize)
+    {
+        return nullptr;
+    }
+    uiUsed = uiStart + uiSize - uiBase;
+    offset = uiStart;
+    return bPersistent ? pMapped + uiStart : pMapped + (uiStart - uiBase);
+}
+
+void RingBuffer::flush()
+{
+    if (!bPersistent && pMapped)
+    {
+        glBindBuffer(eTarget, uiBuffer);
+        glUnmapBuffer(eTarget);
+        glBindBuffer(eTarget, 0);
+        pMapped = nullptr;
+    }
+}
+
+void RingBuffer::endFrame()
+{
+    if (!uiBuffer)
+    {
+        return;
+    }
+    flush();
+    fences[iFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
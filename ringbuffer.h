@@ -0,0 +1,62 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+//----------------------------------------------------------------------
+// 每帧动态数据的环形上传缓冲区
+// 缓冲区分成 iFrames 段，每帧写入一段，GPU 读完后（段上的栅栏触发）才会再次写入同一段，
+// 不需要每帧 glBufferData 重新分配，也不会触发驱动的隐式同步。
+// 支持 GL_ARB_buffer_storage 时整个缓冲区持久、一致地映射；否则每帧用不同步的 glMapBufferRange 映射当前段
+//----------------------------------------------------------------------
+class RingBuffer
+{
+public:
+    RingBuffer();
+    ~RingBuffer();
+
+    //----------------------------------------------------------------------
+    // 创建缓冲区
+    // eTarget: 映射时绑定的目标，例如 GL_TEXTURE_BUFFER、GL_DRAW_INDIRECT_BUFFER
+    // uiFrameSize: 每帧最多写入的字节数
+    // iFrames: 段数，3 表示 CPU 最多领先 GPU 两帧
+    // bAllowPersistent: 为 false 时不使用持久映射；持久映射失败时也退回每帧映射
+    //----------------------------------------------------------------------
+    bool init(GLenum eTarget, size_t uiFrameSize, int iFrames = 3, bool bAllowPersistent = true);
+    void release();
+
+    // 帧开始时调用：切换到下一段，等待 GPU 用完该段；每次 beginFrame 都应该有对应的 endFrame
+    void beginFrame();
+
+    //----------------------------------------------------------------------
+    // 在当前段中分配 uiSize 字节，起点按 uiAlignment 对齐
+    // offset: 返回分配在整个缓冲区中的偏移，绑定或绘制时使用
+    // 当前段空间不足时返回 nullptr
+    //----------------------------------------------------------------------
+    void *allocate(size_t uiSize, size_t uiAlignment, size_t &offset);
+
+    // 本帧的数据写完后、使用它们的 GL 命令之前调用：非持久映射时取消映射，持久映射时什么都不做
+    void flush();
+
+    // 帧结束时调用，在使用本帧数据的绘制命令之后：插入栅栏
+    void endFrame();
+
+    GLuint getBuffer() const { return uiBuffer; }
+    bool isPersistent() const { return bPersistent; }
+    size_t getFrameSize() const { return uiFrameSize; }
+
+private:
+    RingBuffer(const RingBuffer &);
+    RingBuffer &operator=(const RingBuffer &);
+
+    static const int MAX_FRAMES = 4;
+
+    GLenum eTarget;
+    GLuint uiBuffer;
+    size_t uiFrameSize;
+    int iFrames;
+    int iFrame;         // 当前段
+    size_t uiUsed;      // 当前段已分配的字节数
+    bool bPersistent;
+    unsigned char *pMapped; // 持久映射时为整个缓冲区，否则为当前段
+    GLsync fences[MAX_FRAMES];
+};
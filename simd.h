@@ -0,0 +1,70 @@
+#pragma once
+
+//----------------------------------------------------------------------
+// SIMD 支持：编译期判断指令集是否可用，运行期检测 CPU 支持的最高级别
+// AVX2 路径的函数用 SIMD_TARGET_AVX2 标记单独编译，其余代码仍按默认目标编译，
+// 在不支持 AVX2 的机器上只要不调用这些函数就不会出错
+//----------------------------------------------------------------------
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+// 只开启 AVX2，不开启 FMA：乘加保持两次舍入，结果与标量代码逐位一致
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_SSE2
+#endif
+
+enum SIMD_LEVEL
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+//----------------------------------------------------------------------
+// 检测 CPU 与操作系统支持的 SIMD 级别，结果只计算一次
+//----------------------------------------------------------------------
+inline SIMD_LEVEL DetectSimdLevel()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int iMaxLeaf = info[0];
+    __cpuid(info, 1);
+    bool bSSE2 = (info[3] & (1 << 26)) != 0;
+    bool bOSXSave = (info[2] & (1 << 27)) != 0;
+    bool bAVX = (info[2] & (1 << 28)) != 0;
+    bool bAVX2 = false;
+    // 操作系统需要保存 YMM 寄存器
+    if (bOSXSave && bAVX && (_xgetbv(0) & 6) == 6 && iMaxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        bAVX2 = (info[1] & (1 << 5)) != 0;
+    }
+    return bAVX2 ? SIMD_AVX2 : (bSSE2 ? SIMD_SSE2 : SIMD_SCALAR);
+#elif defined(SIMD_X86)
+    // libgcc 的检测已经包含操作系统是否支持 YMM 寄存器
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMD_AVX2;
+    }
+    return __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+inline SIMD_LEVEL GetSimdLevel()
+{
+    static const SIMD_LEVEL level = DetectSimdLevel();
+    return level;
+}
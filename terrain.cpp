@@ -1,27 +1,148 @@
 #include "terrain.h"
+#include "simd.h"
+#include "terrain_util.h"
 #include <stdlib.h>
+#include <string.h>
+
+// 纵向滤波每次处理的列数：64 个 float 为 4 条缓存行，一个列块的所有行（4097 行约 1MB）
+// 可以留在 L2 中，自上而下和自下而上两遍之间不会被挤出
+#define TRN_FILTER_BLOCK 64
+
 //----------------------------------------------------------------------
-// Apply the erosion filter to an entire buffer
-//					of height values
+// 对 [iCol0, iCol1) 列做自上而下、自下而上两遍滤波
+// 每一列都是独立的递推，按行推进时一行中的多列同时计算，访问的内存是连续的
 //----------------------------------------------------------------------
-void CTERRAIN::FilterHeightField(float *fpHeightData, float fFilter)
+static void FilterColumnsScalar(float *fpData, int iSize, int iCol0, int iCol1, float fFilter)
 {
-    int i;
-    // erode left to right
-    for (i = 0; i < m_iSize; i++)
-        FilterHeightBand(&fpHeightData[m_iSize * i], 1, m_iSize, fFilter);
+    float fKeep = 1 - fFilter;
+    for (int r = 1; r < iSize; r++)
+    {
+        const float *fpPrev = &fpData[(size_t)(r - 1) * iSize];
+        float *fpRow = &fpData[(size_t)r * iSize];
+        for (int c = iCol0; c < iCol1; c++)
+        {
+            fpRow[c] = fFilter * fpPrev[c] + fKeep * fpRow[c];
+        }
+    }
+    for (int r = iSize - 2; r >= 0; r--)
+    {
+        const float *fpPrev = &fpData[(size_t)(r + 1) * iSize];
+        float *fpRow = &fpData[(size_t)r * iSize];
+        for (int c = iCol0; c < iCol1; c++)
+        {
+            fpRow[c] = fFilter * fpPrev[c] + fKeep * fpRow[c];
+        }
+    }
+}
 
-    // erode right to left
-    for (i = 0; i < m_iSize; i++)
-        FilterHeightBand(&fpHeightData[m_iSize * i + m_iSize - 1], -1, m_iSize, fFilter);
+#ifdef SIMD_X86
+SIMD_TARGET_SSE2 static void FilterColumnsSSE2(float *fpData, int iSize, int iCol0, int iCol1, float fFilter)
+{
+    float fKeep = 1 - fFilter;
+    __m128 vFilter = _mm_set1_ps(fFilter);
+    __m128 vKeep = _mm_set1_ps(fKeep);
+    int iVecEnd = iCol0 + (iCol1 - iCol0) / 4 * 4;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int k = 1; k < iSize; k++)
+        {
+            // 第一遍自上而下，第二遍自下而上
+            int r = pass == 0 ? k : iSize - 1 - k;
+            int p = pass == 0 ? r - 1 : r + 1;
+            const float *fpPrev = &fpData[(size_t)p * iSize];
+            float *fpRow = &fpData[(size_t)r * iSize];
+            int c = iCol0;
+            for (; c < iVecEnd; c += 4)
+            {
+                __m128 v = _mm_add_ps(_mm_mul_ps(vFilter, _mm_loadu_ps(&fpPrev[c])), _mm_mul_ps(vKeep, _mm_loadu_ps(&fpRow[c])));
+                _mm_storeu_ps(&fpRow[c], v);
+            }
+            for (; c < iCol1; c++)
+            {
+                fpRow[c] = fFilter * fpPrev[c] + fKeep * fpRow[c];
+            }
+        }
+    }
+}
 
-    // erode top to bottom
-    for (i = 0; i < m_iSize; i++)
-        FilterHeightBand(&fpHeightData[i], m_iSize, m_iSize, fFilter);
+SIMD_TARGET_AVX2 static void FilterColumnsAVX2(float *fpData, int iSize, int iCol0, int iCol1, float fFilter)
+{
+    float fKeep = 1 - fFilter;
+    __m256 vFilter = _mm256_set1_ps(fFilter);
+    __m256 vKeep = _mm256_set1_ps(fKeep);
+    int iVecEnd = iCol0 + (iCol1 - iCol0) / 8 * 8;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int k = 1; k < iSize; k++)
+        {
+            int r = pass == 0 ? k : iSize - 1 - k;
+            int p = pass == 0 ? r - 1 : r + 1;
+            const float *fpPrev = &fpData[(size_t)p * iSize];
+            float *fpRow = &fpData[(size_t)r * iSize];
+            int c = iCol0;
+            for (; c < iVecEnd; c += 8)
+            {
+                __m256 v = _mm256_add_ps(_mm256_mul_ps(vFilter, _mm256_loadu_ps(&fpPrev[c])), _mm256_mul_ps(vKeep, _mm256_loadu_ps(&fpRow[c])));
+                _mm256_storeu_ps(&fpRow[c], v);
+            }
+            for (; c < iCol1; c++)
+            {
+                fpRow[c] = fFilter * fpPrev[c] + fKeep * fpRow[c];
+            }
+        }
+    }
+}
+#endif
+
+typedef void (*FilterColumnsFunc)(float *fpData, int iSize, int iCol0, int iCol1, float fFilter);
+
+//----------------------------------------------------------------------
+// 按 CPU 支持的指令集选择纵向滤波的实现
+//----------------------------------------------------------------------
+static FilterColumnsFunc GetFilterColumns()
+{
+#ifdef SIMD_X86
+    switch (GetSimdLevel())
+    {
+    case SIMD_AVX2:
+        return FilterColumnsAVX2;
+    case SIMD_SSE2:
+        return FilterColumnsSSE2;
+    default:
+        break;
+    }
+#endif
+    return FilterColumnsScalar;
+}
+
+//----------------------------------------------------------------------
+// Apply the erosion filter to an entire buffer
+//					of height values
+// iThreads: 每一行、每一列的滤波互不影响，按行、按列块分给多个线程，结果与单线程完全相同
+//----------------------------------------------------------------------
+void CTERRAIN::FilterHeightField(float *fpHeightData, float fFilter, int iThreads)
+{
+    // erode left to right, then right to left
+    ParallelRange(m_iSize, iThreads, [&](int iBegin, int iEnd)
+                  {
+        for (int i = iBegin; i < iEnd; i++)
+        {
+            FilterHeightBand(&fpHeightData[(size_t)m_iSize * i], 1, m_iSize, fFilter);
+            FilterHeightBand(&fpHeightData[(size_t)m_iSize * i + m_iSize - 1], -1, m_iSize, fFilter);
+        } });
 
-    // erode from bottom to top
-    for (i = 0; i < m_iSize; i++)
-        FilterHeightBand(&fpHeightData[m_iSize * (m_iSize - 1) + i], -m_iSize, m_iSize, fFilter);
+    // erode top to bottom, then bottom to top
+    // 逐列按 m_iSize 的步长访问会频繁缺失缓存，改为按列块逐行处理，块内的列作为 SIMD 通道
+    static const FilterColumnsFunc filterColumns = GetFilterColumns();
+    int iBlocks = (m_iSize + TRN_FILTER_BLOCK - 1) / TRN_FILTER_BLOCK;
+    ParallelRange(iBlocks, iThreads, [&](int iBegin, int iEnd)
+                  {
+        for (int b = iBegin; b < iEnd; b++)
+        {
+            int iCol0 = b * TRN_FILTER_BLOCK;
+            int iCol1 = iCol0 + TRN_FILTER_BLOCK < m_iSize ? iCol0 + TRN_FILTER_BLOCK : m_iSize;
+            filterColumns(fpHeightData, m_iSize, iCol0, iCol1, fFilter);
+        } });
 }
 
 //----------------------------------------------------------------------
@@ -47,6 +168,46 @@ void CTERRAIN::FilterHeightBand(float *fpBand, int iStride, int iCount, float fF
     }
 }
 
+//----------------------------------------------------------------------
+// 向下取整的整数除法，b > 0
+//----------------------------------------------------------------------
+static long long FloorDiv(long long a, long long b)
+{
+    long long q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+//----------------------------------------------------------------------
+// 求断层线在第 z 行上抬高的区间 [*piStart, *piEnd)
+// 点 (x, z) 满足 (x - iX1) * iDirZ - iDirX * (z - iZ1) > 0 时抬高，
+// 即 x * iDirZ > c，其中 c = iX1 * iDirZ + iDirX * (z - iZ1)，每行只需一次除法
+//----------------------------------------------------------------------
+static void FaultSpan(int iSize, int iX1, int iZ1, int iDirX, int iDirZ, int z, int *piStart, int *piEnd)
+{
+    long long c = (long long)iX1 * iDirZ + (long long)iDirX * (z - iZ1);
+    long long start, end;
+    if (iDirZ > 0)
+    {
+        // x > c / iDirZ，抬高右侧
+        start = FloorDiv(c, iDirZ) + 1;
+        end = iSize;
+    }
+    else if (iDirZ < 0)
+    {
+        // x * |iDirZ| < -c，抬高左侧
+        start = 0;
+        end = -FloorDiv(c, -iDirZ);
+    }
+    else
+    {
+        // 水平断层线，整行要么全部抬高要么都不抬高
+        start = 0;
+        end = -c > 0 ? iSize : 0;
+    }
+    *piStart = (int)(start < 0 ? 0 : (start > iSize ? iSize : start));
+    *piEnd = (int)(end < 0 ? 0 : (end > iSize ? iSize : end));
+}
+
 //----------------------------------------------------------------------
 // 创建高度数据集
 // isize 高度图的大小
@@ -54,87 +215,144 @@ void CTERRAIN::FilterHeightBand(float *fpBand, int iStride, int iCount, float fF
 // imindelta 最小高度
 // imaxdelta 最大高度
 // ffilter 高度过滤器
+// iFilterInterval 每隔多少次迭代执行一次过滤，<= 0 时只在最后过滤一次；最后一次迭代之后总会过滤
 //----------------------------------------------------------------------
-bool CTERRAIN::MakeTerrainFault(int iSize, int iIterations, int iMinDelta, int iMaxDelta, float fFilter)
+bool CTERRAIN::MakeTerrainFault(int iSize, int iIterations, int iMinDelta, int iMaxDelta, float fFilter, int iFilterInterval)
 {
-    float *fTempBuffer;
-    int iCurrentIteration;
-    int iHeight;
     int iRandX1, iRandZ1;
     int iRandX2, iRandZ2;
-    int iDirX1, iDirZ1;
-    int iDirX2, iDirZ2;
-    int x, z;
-    int i;
 
-    if (m_heightData.m_ucpData)
+    std::vector<STRN_FAULT_LINE> faults(iIterations > 0 ? iIterations : 0);
+    for (int iCurrentIteration = 0; iCurrentIteration < iIterations; iCurrentIteration++)
     {
-        UnloadHeightMap();
+        STRN_FAULT_LINE &fault = faults[iCurrentIteration];
+        // calculate the height range (linear interpolation from iMaxDelta to
+        // iMinDelta) for this fault-pass
+        fault.fHeight = (float)(iMaxDelta - ((iMaxDelta - iMinDelta) * iCurrentIteration) / iIterations);
+        // pick two points at random from the entire height map
+        iRandX1 = rand() % iSize;
+        iRandZ1 = rand() % iSize;
+
+        // check to make sure that the points are not the same
+        do
+        {
+            iRandX2 = rand() % iSize;
+            iRandZ2 = rand() % iSize;
+        } while (iRandX2 == iRandX1 && iRandZ2 == iRandZ1);
+
+        // iDirX, iDirZ is a vector going the same direction as the line
+        fault.iX1 = iRandX1;
+        fault.iZ1 = iRandZ1;
+        fault.iDirX = iRandX2 - iRandX1;
+        fault.iDirZ = iRandZ2 - iRandZ1;
     }
+    return ApplyTerrainFaults(iSize, faults, fFilter, iFilterInterval, 1);
+}
+
+//----------------------------------------------------------------------
+// 用给定的种子创建高度数据集，参数同上
+// uiSeed: 64 位随机种子，相同的种子和参数在任何平台上生成相同的地形
+// iThreads: 工作线程数，<= 0 时使用全部核心；结果与线程数无关
+// 每条断层线由种子和它的序号单独生成，不依赖全局 rand() 的状态
+//----------------------------------------------------------------------
+bool CTERRAIN::MakeTerrainFault(int iSize, int iIterations, int iMinDelta, int iMaxDelta, float fFilter, uint64_t uiSeed, int iThreads, int iFilterInterval)
+{
+    if (iSize < 2)
+    {
+        return false;
+    }
+    std::vector<STRN_FAULT_LINE> faults = MakeFaultLines(iSize, iIterations, iMinDelta, iMaxDelta, uiSeed);
+    return ApplyTerrainFaults(iSize, faults, fFilter, iFilterInterval, ResolveThreadCount(iThreads));
+}
+
+//----------------------------------------------------------------------
+// 由种子生成断层线，CPU 与 GPU 的断层生成共用
+//----------------------------------------------------------------------
+std::vector<STRN_FAULT_LINE> CTERRAIN::MakeFaultLines(int iSize, int iIterations, int iMinDelta, int iMaxDelta, uint64_t uiSeed)
+{
+    std::vector<STRN_FAULT_LINE> faults(iIterations > 0 ? iIterations : 0);
+    for (int iCurrentIteration = 0; iCurrentIteration < iIterations; iCurrentIteration++)
+    {
+        STRN_FAULT_LINE &fault = faults[iCurrentIteration];
+        uint64_t uiState = uiSeed ^ ((uint64_t)iCurrentIteration * 0xD1B54A32D192ED03ull);
+        fault.fHeight = (float)(iMaxDelta - ((iMaxDelta - iMinDelta) * iCurrentIteration) / iIterations);
+        fault.iX1 = RandomBelow(uiState, iSize);
+        fault.iZ1 = RandomBelow(uiState, iSize);
+        int iX2, iZ2;
+        do
+        {
+            iX2 = RandomBelow(uiState, iSize);
+            iZ2 = RandomBelow(uiState, iSize);
+        } while (iX2 == fault.iX1 && iZ2 == fault.iZ1);
+        fault.iDirX = iX2 - fault.iX1;
+        fault.iDirZ = iZ2 - fault.iZ1;
+    }
+    return faults;
+}
+
+//----------------------------------------------------------------------
+// 依次应用断层线生成高度数据
+// 断层按行分给多个线程：每个格子上的高度仍按断层的顺序累加，过滤也是按行、按列独立进行，
+// 因此结果与线程数无关
+//----------------------------------------------------------------------
+bool CTERRAIN::ApplyTerrainFaults(int iSize, const std::vector<STRN_FAULT_LINE> &faults, float fFilter, int iFilterInterval, int iThreads)
+{
+    float *fTempBuffer;
 
-    m_iSize = iSize;
     // allocate the height data
-    m_heightData.m_ucpData = new unsigned char[m_iSize * m_iSize];
+    if (!AllocHeightData(iSize))
+    {
+        return false;
+    }
     fTempBuffer = new float[m_iSize * m_iSize];
 
-    if (m_heightData.m_ucpData == nullptr || fTempBuffer == nullptr)
+    if (fTempBuffer == nullptr)
     {
         return false;
     }
 
     // clear the height fTempBuffer
-    for (size_t i = 0; i < m_iSize * m_iSize; i++)
+    for (size_t i = 0; i < (size_t)m_iSize * m_iSize; i++)
     {
         fTempBuffer[i] = 0.0f;
     }
 
-    for (iCurrentIteration = 0; iCurrentIteration < iIterations; iCurrentIteration++)
+    int iIterations = (int)faults.size();
+    int iFirst = 0; // 上次过滤之后的第一条断层
+    for (int iCurrentIteration = 0; iCurrentIteration < iIterations; iCurrentIteration++)
     {
-        // calculate the height range (linear interpolation from iMaxDelta to
-        // iMinDelta) for this fault-pass
-        iHeight = iMaxDelta - ((iMaxDelta - iMinDelta) * iCurrentIteration) / iIterations;
-        // pick two points at random from the entire height map
-        iRandX1 = rand() % m_iSize;
-        iRandZ1 = rand() % m_iSize;
-
-        // check to make sure that the points are not the same
-        do
+        if (!((iFilterInterval > 0 && (iCurrentIteration + 1) % iFilterInterval == 0) || iCurrentIteration == iIterations - 1))
         {
-            iRandX2 = rand() % m_iSize;
-            iRandZ2 = rand() % m_iSize;
-        } while (iRandX2 == iRandX1 && iRandZ2 == iRandZ1);
-
-        // iDirX1, iDirZ1 is a vector going the same direction as the line
-        iDirX1 = iRandX2 - iRandX1;
-        iDirZ1 = iRandZ2 - iRandZ1;
+            continue;
+        }
 
-        for (z = 0; z < m_iSize; z++)
-        {
-            for (x = 0; x < m_iSize; x++)
+        // 断层线一侧在每一行上都是连续的区间，算出区间后整段抬高，内层循环没有分支
+        ParallelRange(m_iSize, iThreads, [&](int iBegin, int iEnd)
+                      {
+            int iStart, iStop;
+            for (int row = iBegin; row < iEnd; row++)
             {
-                // iDirX2, iDirZ2 is a vector from iRandX1, iRandZ1 to the current point (in the loop)
-                iDirX2 = x - iRandX1;
-                iDirZ2 = z - iRandZ1;
-
-                // if the result of ( iDirX2*iDirZ1 - iDirX1*iDirZ2 ) is "up" (above 0),
-                // then raise this point by iHeight
-                if ((iDirX2 * iDirZ1 - iDirX1 * iDirZ2) > 0)
-                    fTempBuffer[(z * m_iSize) + x] += (float)iHeight;
-            }
-        }
+                float *fpRow = &fTempBuffer[(size_t)row * m_iSize];
+                for (int f = iFirst; f <= iCurrentIteration; f++)
+                {
+                    const STRN_FAULT_LINE &fault = faults[f];
+                    FaultSpan(m_iSize, fault.iX1, fault.iZ1, fault.iDirX, fault.iDirZ, row, &iStart, &iStop);
+                    for (int col = iStart; col < iStop; col++)
+                    {
+                        fpRow[col] += fault.fHeight;
+                    }
+                }
+            } });
 
-        FilterHeightField(fTempBuffer, fFilter);
+        FilterHeightField(fTempBuffer, fFilter, iThreads);
+        iFirst = iCurrentIteration + 1;
     }
 
-    // normalize the terrain for our purposes
-    NormalizeTerrain(fTempBuffer);
+    // 侵蚀（未设置时直接跳过）
+    ErodeTerrain(fTempBuffer, iThreads);
 
-    // transfer the terrain into our class's unsigned char height buffer
-    for (z = 0; z < m_iSize; z++)
-    {
-        for (x = 0; x < m_iSize; x++)
-            SetHeightAtPoint((unsigned char)fTempBuffer[(z * m_iSize) + x], x, z);
-    }
+    // normalize the terrain and transfer it into our class's height buffer
+    NormalizeTerrain(fTempBuffer, iThreads);
 
     // delete temporary buffer
     if (fTempBuffer)
@@ -145,39 +363,234 @@ bool CTERRAIN::MakeTerrainFault(int iSize, int iIterations, int iMinDelta, int i
     return true;
 }
 
-//----------------------------------------------------------------------
-// Scale the terrain height values to a range of 0-255
-//----------------------------------------------------------------------
-void CTERRAIN::NormalizeTerrain(float *fpHeightData)
+// 量化的通用部分：h = (x - fMin) / fRange * fScale，截断为整数，与原先先归一化再转换的结果一致
+static inline float ScaleHeight(float x, float fMin, float fRange, float fScale)
 {
-    float fMin, fMax;
-    float fHeight;
-    int i;
+    return ((x - fMin) / fRange) * fScale;
+}
 
-    fMin = fpHeightData[0];
-    fMax = fpHeightData[0];
+static void MinMaxScalar(const float *fpData, size_t count, float *pfMin, float *pfMax)
+{
+    float fMin = *pfMin, fMax = *pfMax;
+    for (size_t i = 0; i < count; i++)
+    {
+        fMin = fpData[i] < fMin ? fpData[i] : fMin;
+        fMax = fpData[i] > fMax ? fpData[i] : fMax;
+    }
+    *pfMin = fMin;
+    *pfMax = fMax;
+}
 
-    // find the min/max values of the height fTempBuffer
-    for (i = 1; i < m_iSize * m_iSize; i++)
+static void QuantizeScalar(const float *fpData, size_t count, float fMin, float fRange, void *pDst, int iBits)
+{
+    if (iBits == 16)
     {
-        if (fpHeightData[i] < fMin)
-            fMin = fpHeightData[i];
-        if (fpHeightData[i] > fMax)
-            fMax = fpHeightData[i];
+        unsigned short *dst = (unsigned short *)pDst;
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = (unsigned short)ScaleHeight(fpData[i], fMin, fRange, 65535.0f);
+        }
+        return;
+    }
+    unsigned char *dst = (unsigned char *)pDst;
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = (unsigned char)ScaleHeight(fpData[i], fMin, fRange, 255.0f);
     }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_SSE2 static void MinMaxSSE2(const float *fpData, size_t count, float *pfMin, float *pfMax)
+{
+    __m128 vMin = _mm_set1_ps(*pfMin);
+    __m128 vMax = _mm_set1_ps(*pfMax);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(&fpData[i]);
+        vMin = _mm_min_ps(vMin, v);
+        vMax = _mm_max_ps(vMax, v);
+    }
+    float mins[4], maxs[4];
+    _mm_storeu_ps(mins, vMin);
+    _mm_storeu_ps(maxs, vMax);
+    MinMaxScalar(mins, 4, pfMin, pfMax);
+    MinMaxScalar(maxs, 4, pfMin, pfMax);
+    MinMaxScalar(&fpData[i], count - i, pfMin, pfMax);
+}
+
+SIMD_TARGET_SSE2 static void QuantizeSSE2(const float *fpData, size_t count, float fMin, float fRange, void *pDst, int iBits)
+{
+    __m128 vMin = _mm_set1_ps(fMin);
+    __m128 vRange = _mm_set1_ps(fRange);
+    size_t i = 0;
+    if (iBits == 16)
+    {
+        // SSE2 只有有符号饱和打包，先平移到有符号范围，打包后再翻转最高位
+        __m128 vScale = _mm_set1_ps(65535.0f);
+        __m128i vShift = _mm_set1_epi32(32768);
+        __m128i vFlip = _mm_set1_epi16((short)0x8000);
+        unsigned short *dst = (unsigned short *)pDst;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(&fpData[i]), vMin), vRange), vScale));
+            __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(&fpData[i + 4]), vMin), vRange), vScale));
+            __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, vShift), _mm_sub_epi32(b, vShift));
+            _mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(packed, vFlip));
+        }
+        QuantizeScalar(&fpData[i], count - i, fMin, fRange, &dst[i], iBits);
+        return;
+    }
+    __m128 vScale = _mm_set1_ps(255.0f);
+    unsigned char *dst = (unsigned char *)pDst;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i q[4];
+        for (int k = 0; k < 4; k++)
+        {
+            q[k] = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(&fpData[i + k * 4]), vMin), vRange), vScale));
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        _mm_storeu_si128((__m128i *)&dst[i], packed);
+    }
+    QuantizeScalar(&fpData[i], count - i, fMin, fRange, &dst[i], iBits);
+}
+
+SIMD_TARGET_AVX2 static void MinMaxAVX2(const float *fpData, size_t count, float *pfMin, float *pfMax)
+{
+    __m256 vMin = _mm256_set1_ps(*pfMin);
+    __m256 vMax = _mm256_set1_ps(*pfMax);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(&fpData[i]);
+        vMin = _mm256_min_ps(vMin, v);
+        vMax = _mm256_max_ps(vMax, v);
+    }
+    float mins[8], maxs[8];
+    _mm256_storeu_ps(mins, vMin);
+    _mm256_storeu_ps(maxs, vMax);
+    MinMaxScalar(mins, 8, pfMin, pfMax);
+    MinMaxScalar(maxs, 8, pfMin, pfMax);
+    MinMaxScalar(&fpData[i], count - i, pfMin, pfMax);
+}
+
+SIMD_TARGET_AVX2 static void QuantizeAVX2(const float *fpData, size_t count, float fMin, float fRange, void *pDst, int iBits)
+{
+    __m256 vMin = _mm256_set1_ps(fMin);
+    __m256 vRange = _mm256_set1_ps(fRange);
+    __m256 vScale = _mm256_set1_ps(iBits == 16 ? 65535.0f : 255.0f);
+    size_t i = 0;
+    // AVX2 的打包指令按 128 位分别进行，打包后用 permute 恢复顺序
+    if (iBits == 16)
+    {
+        unsigned short *dst = (unsigned short *)pDst;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&fpData[i]), vMin), vRange), vScale));
+            __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&fpData[i + 8]), vMin), vRange), vScale));
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+            _mm256_storeu_si256((__m256i *)&dst[i], packed);
+        }
+        QuantizeScalar(&fpData[i], count - i, fMin, fRange, &dst[i], iBits);
+        return;
+    }
+    unsigned char *dst = (unsigned char *)pDst;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i q[4];
+        for (int k = 0; k < 4; k++)
+        {
+            q[k] = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&fpData[i + k * 8]), vMin), vRange), vScale));
+        }
+        __m256i lo = _mm256_permute4x64_epi64(_mm256_packus_epi32(q[0], q[1]), 0xD8);
+        __m256i hi = _mm256_permute4x64_epi64(_mm256_packus_epi32(q[2], q[3]), 0xD8);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i *)&dst[i], packed);
+    }
+    QuantizeScalar(&fpData[i], count - i, fMin, fRange, &dst[i], iBits);
+}
+#endif
+
+//----------------------------------------------------------------------
+// Scale the terrain height values to a range of 0-255 (16 位精度时为 0-65535)
+// and store them in m_heightData
+// 先并行求最小、最大值，再在一遍中完成缩放与量化，直接写入高度数据
+//----------------------------------------------------------------------
+void CTERRAIN::NormalizeTerrain(const float *fpHeightData, int iThreads)
+{
+    void (*minMax)(const float *, size_t, float *, float *) = MinMaxScalar;
+    void (*quantize)(const float *, size_t, float, float, void *, int) = QuantizeScalar;
+#ifdef SIMD_X86
+    switch (GetSimdLevel())
+    {
+    case SIMD_AVX2:
+        minMax = MinMaxAVX2;
+        quantize = QuantizeAVX2;
+        break;
+    case SIMD_SSE2:
+        minMax = MinMaxSSE2;
+        quantize = QuantizeSSE2;
+        break;
+    default:
+        break;
+    }
+#endif
+
+    // 每个线程处理一段连续的行，得到各自的最小、最大值后再合并，结果与分段方式无关
+    int iChunks = iThreads > 1 ? iThreads : 1;
+    size_t rowSize = (size_t)m_iSize;
+    std::vector<float> mins(iChunks, fpHeightData[0]);
+    std::vector<float> maxs(iChunks, fpHeightData[0]);
+    ParallelRange(iChunks, iThreads, [&](int iBegin, int iEnd)
+                  {
+        for (int c = iBegin; c < iEnd; c++)
+        {
+            size_t row0 = rowSize * c / iChunks;
+            size_t row1 = rowSize * (c + 1) / iChunks;
+            minMax(&fpHeightData[row0 * rowSize], (row1 - row0) * rowSize, &mins[c], &maxs[c]);
+        } });
+    float fMin = mins[0], fMax = maxs[0];
+    MinMaxScalar(mins.data(), mins.size(), &fMin, &fMax);
+    MinMaxScalar(maxs.data(), maxs.size(), &fMin, &fMax);
+
+    int iBits = m_heightData.m_iBits;
+    size_t bytesPerHeight = iBits == 16 ? sizeof(unsigned short) : sizeof(unsigned char);
+    unsigned char *pDst = iBits == 16 ? (unsigned char *)m_heightData.m_uspData : m_heightData.m_ucpData;
     // find the range of the altitue
     if (fMax <= fMin)
     {
+        memset(pDst, 0, rowSize * rowSize * bytesPerHeight);
         return;
     }
+    float fRange = fMax - fMin;
 
-    fHeight = fMax - fMin;
+    ParallelRange(iChunks, iThreads, [&](int iBegin, int iEnd)
+                  {
+        for (int c = iBegin; c < iEnd; c++)
+        {
+            size_t row0 = rowSize * c / iChunks;
+            size_t row1 = rowSize * (c + 1) / iChunks;
+            quantize(&fpHeightData[row0 * rowSize], (row1 - row0) * rowSize, fMin, fRange, pDst + row0 * rowSize * bytesPerHeight, iBits);
+        } });
+}
 
-    // scale the values to a range of 0-255 (because I like things that way)
-    for (i = 0; i < m_iSize * m_iSize; i++)
+//----------------------------------------------------------------------
+// 按当前精度（m_heightData.m_iBits）分配 iSize x iSize 的高度数据
+//----------------------------------------------------------------------
+bool CTERRAIN::AllocHeightData(int iSize)
+{
+    UnloadHeightMap();
+
+    m_iSize = iSize;
+    m_heightData.m_iSize = iSize;
+    if (m_heightData.m_iBits == 16)
     {
-        fpHeightData[i] = ((fpHeightData[i] - fMin) / fHeight) * 255.0f;
+        m_heightData.m_uspData = new unsigned short[(size_t)iSize * iSize];
+        return m_heightData.m_uspData != nullptr;
     }
+    m_heightData.m_ucpData = new unsigned char[(size_t)iSize * iSize];
+    return m_heightData.m_ucpData != nullptr;
 }
 
 //----------------------------------------------------------------------
@@ -191,4 +604,10 @@ void CTERRAIN::UnloadHeightMap()
         m_heightData.m_ucpData = nullptr;
         m_iSize = 0;
     }
+    if (m_heightData.m_uspData)
+    {
+        delete[] m_heightData.m_uspData;
+        m_heightData.m_uspData = nullptr;
+        m_iSize = 0;
+    }
 }
@@ -1,11 +1,67 @@
 #pragma once
+#include <cstdint>
+#include <vector>
 
 struct STRN_HEIGHT_DATA
 {
     unsigned char* m_ucpData; // the height data
+    unsigned short* m_uspData; // 16 位精度时的高度数据，此时 m_ucpData 为空
+    int m_iBits; // 每个高度的位数，8 或 16
     int m_iSize; // the height size (must be a power of 2)
 };
 
+// 一条断层线：经过 (iX1, iZ1)，方向为 (iDirX, iDirZ)，一侧抬高 fHeight
+struct STRN_FAULT_LINE
+{
+    int iX1, iZ1;
+    int iDirX, iDirZ;
+    float fHeight;
+};
+
+// fBm 的一个八度：fFrequency 为整张地图上的周期数，fAmplitude 为振幅
+struct STRN_NOISE_OCTAVE
+{
+    float fFrequency;
+    float fAmplitude;
+};
+
+//----------------------------------------------------------------------
+// 侵蚀参数，高度先按整张地图的高差归一化到 [0, 1]，各参数都以此为单位
+//----------------------------------------------------------------------
+struct STRN_EROSION_SETTINGS
+{
+    int iThermalIterations;   // 热力侵蚀迭代次数，0 表示不进行
+    float fTalus;             // 休止角：相邻格子高差超过 fTalus / 地图大小时开始崩塌
+    float fThermalRate;       // 每次迭代移动超出休止角部分的比例
+
+    int iHydraulicIterations; // 水力侵蚀迭代次数，0 表示不进行
+    float fRain;              // 每次迭代每个格子的平均降水量
+    float fSolubility;        // 每单位水溶解的土壤
+    float fEvaporation;       // 每次迭代蒸发的水的比例
+    float fCapacity;          // 每单位水能携带的沉积物
+
+    uint64_t uiSeed;          // 降水分布的随机种子，相同的种子得到相同的结果
+};
+
+// 生成默认的侵蚀参数
+inline STRN_EROSION_SETTINGS MakeErosionSettings(int iThermalIterations, int iHydraulicIterations, uint64_t uiSeed)
+{
+    STRN_EROSION_SETTINGS settings;
+    settings.iThermalIterations = iThermalIterations;
+    settings.fTalus = 4.0f;
+    settings.fThermalRate = 0.5f;
+    settings.iHydraulicIterations = iHydraulicIterations;
+    settings.fRain = 0.01f;
+    settings.fSolubility = 0.01f;
+    settings.fEvaporation = 0.5f;
+    settings.fCapacity = 0.01f;
+    settings.uiSeed = uiSeed;
+    return settings;
+}
+
+// 进度回调，fProgress 为 0 ~ 1，在调用生成函数的线程上调用
+typedef void (*STRN_PROGRESS_FUNC)(float fProgress, void* pUserData);
+
 class CTERRAIN
 {
     protected:
@@ -15,17 +71,55 @@ class CTERRAIN
     int m_iVertsPerFrame; //stat variables
     int m_iTrisPerFrame;
 
-    bool MakeTerrainFault(int iSize,int iIterations,int iMinDelta,int iMaxDelta,float fFilter);
+    STRN_EROSION_SETTINGS m_erosion; // 生成之后、归一化之前执行的侵蚀
+    STRN_PROGRESS_FUNC m_pfnProgress;
+    void* m_pProgressData;
+
+    bool MakeTerrainFault(int iSize,int iIterations,int iMinDelta,int iMaxDelta,float fFilter,int iFilterInterval = 1);
+    bool ApplyTerrainFaults(int iSize,const std::vector<STRN_FAULT_LINE>& faults,float fFilter,int iFilterInterval,int iThreads);
     
-    void NormalizeTerrain(float* fpHeightData);
+    bool AllocHeightData(int iSize);
+    void NormalizeTerrain(const float* fpHeightData,int iThreads = 1);
     void FilterHeightBand( float* fpBand, int iStride, int iCount, float fFilter );
-    void FilterHeightField(float* fpHeightData,float fFilter);
+    void FilterHeightField(float* fpHeightData,float fFilter,int iThreads = 1);
+    void ErodeTerrain(float* fpHeightData,int iThreads);
 
     public:
     int m_iSize; // the size of the heightmap, must be a power of two
 
     void UnloadHeightMap();
 
+    // 设置生成的高度精度，8 或 16 位，在生成地形之前设置
+    void SetHeightBits(int iBits) { m_heightData.m_iBits = iBits == 16 ? 16 : 8; }
+
+    // 设置侵蚀参数，之后生成的地形在归一化之前都会执行侵蚀
+    void SetErosion(const STRN_EROSION_SETTINGS& settings) { m_erosion = settings; }
+
+    // 设置侵蚀的进度回调
+    void SetProgressCallback(STRN_PROGRESS_FUNC pfnProgress, void* pUserData)
+    {
+        m_pfnProgress = pfnProgress;
+        m_pProgressData = pUserData;
+    }
+
+    //----------------------------------------------------------------------
+    // 用 64 位种子和 iThreads 个线程生成断层地形，相同的种子和参数总是生成相同的地形
+    //----------------------------------------------------------------------
+    bool MakeTerrainFault(int iSize,int iIterations,int iMinDelta,int iMaxDelta,float fFilter,uint64_t uiSeed,int iThreads,int iFilterInterval = 1);
+    static std::vector<STRN_FAULT_LINE> MakeFaultLines(int iSize,int iIterations,int iMinDelta,int iMaxDelta,uint64_t uiSeed);
+
+    //----------------------------------------------------------------------
+    // 菱形-正方形（中点位移）生成地形，iSize 必须为 2^n + 1
+    // fRoughness: 每细分一级随机位移缩小为 2^-fRoughness，越大越平滑
+    //----------------------------------------------------------------------
+    bool MakeTerrainDiamondSquare(int iSize,float fRoughness,uint64_t uiSeed,int iThreads = 0);
+
+    //----------------------------------------------------------------------
+    // 用多个八度的梯度噪声（fBm）生成地形
+    //----------------------------------------------------------------------
+    bool MakeTerrainNoise(int iSize,const std::vector<STRN_NOISE_OCTAVE>& octaves,uint64_t uiSeed,int iThreads = 0);
+    static std::vector<STRN_NOISE_OCTAVE> MakeNoiseOctaves(int iOctaves,float fBaseFrequency,float fLacunarity = 2.0f,float fGain = 0.5f);
+
     //----------------------------------------------------------------------
     // set the true height value at the given point
     //----------------------------------------------------------------------
@@ -34,6 +128,33 @@ class CTERRAIN
         m_heightData.m_ucpData[(z * m_iSize) + x] = ucHeight;
     }
 
-    CTERRAIN(){}
+    inline void SetHeightAtPoint(unsigned short usHeight, int x, int z)
+    {
+        m_heightData.m_uspData[(z * m_iSize) + x] = usHeight;
+    }
+
+    //----------------------------------------------------------------------
+    // 取得某点归一化后的高度，取值范围 [0, 1]
+    //----------------------------------------------------------------------
+    inline float GetNormalizedHeightAtPoint(int x, int z) const
+    {
+        if (m_heightData.m_iBits == 16)
+        {
+            return m_heightData.m_uspData[(z * m_iSize) + x] / 65535.0f;
+        }
+        return m_heightData.m_ucpData[(z * m_iSize) + x] / 255.0f;
+    }
+
+    CTERRAIN()
+    {
+        m_heightData.m_ucpData = nullptr;
+        m_heightData.m_uspData = nullptr;
+        m_heightData.m_iBits = 8;
+        m_heightData.m_iSize = 0;
+        m_iSize = 0;
+        m_erosion = MakeErosionSettings(0, 0, 0);
+        m_pfnProgress = nullptr;
+        m_pProgressData = nullptr;
+    }
     ~CTERRAIN(){}
 };
@@ -0,0 +1,253 @@
+#include "terrain.h"
+#include "terrain_util.h"
+#include <algorithm>
+
+//----------------------------------------------------------------------
+// 侵蚀模拟
+// 每一步都分成两遍：先由当前状态算出每个格子流向 4 个相邻格子的量，再由每个格子收集流入的量写入新状态。
+// 两遍都只读上一遍的结果、只写自己的格子，按行分给多个线程时不需要加锁，结果也与线程数无关
+//----------------------------------------------------------------------
+
+// 相邻格子的顺序：x - 1, x + 1, z - 1, z + 1；流向 k 的量在对方看来来自 EROSION_OPPOSITE[k]
+static const int EROSION_OPPOSITE[4] = {1, 0, 3, 2};
+
+// 求格子 (x, z) 的 4 个相邻格子的下标，超出地图的为 -1
+static inline void ErosionNeighbors(int iSize, int x, int z, long long neighbors[4])
+{
+    long long c = (long long)z * iSize + x;
+    neighbors[0] = x > 0 ? c - 1 : -1;
+    neighbors[1] = x < iSize - 1 ? c + 1 : -1;
+    neighbors[2] = z > 0 ? c - iSize : -1;
+    neighbors[3] = z < iSize - 1 ? c + iSize : -1;
+}
+
+//----------------------------------------------------------------------
+// 热力侵蚀：高差超过休止角 fTalus 的物质按高差比例向较低的相邻格子崩塌
+//----------------------------------------------------------------------
+static void ThermalOutflow(const float *fpHeights, float *fpOut, int iSize, int z0, int z1, float fTalus, float fRate)
+{
+    long long neighbors[4];
+    for (int z = z0; z < z1; z++)
+    {
+        for (int x = 0; x < iSize; x++)
+        {
+            size_t c = (size_t)z * iSize + x;
+            ErosionNeighbors(iSize, x, z, neighbors);
+            float d[4];
+            float fTotal = 0.0f, fMax = 0.0f;
+            for (int k = 0; k < 4; k++)
+            {
+                d[k] = neighbors[k] >= 0 ? fpHeights[c] - fpHeights[neighbors[k]] : 0.0f;
+                if (d[k] > fTalus)
+                {
+                    fTotal += d[k];
+                    fMax = d[k] > fMax ? d[k] : fMax;
+                }
+            }
+            float fMove = fTotal > 0.0f ? fRate * (fMax - fTalus) : 0.0f;
+            for (int k = 0; k < 4; k++)
+            {
+                fpOut[c * 4 + k] = d[k] > fTalus ? fMove * d[k] / fTotal : 0.0f;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 水力侵蚀的水流：水面（地面 + 水）高于相邻格子时，向较低的格子分配水，
+// 最多使本格与较低格子的水面持平。fpOut 为流向每个相邻格子的水量
+//----------------------------------------------------------------------
+static void WaterOutflow(const float *fpHeights, const float *fpWater, float *fpOut, int iSize, int z0, int z1)
+{
+    long long neighbors[4];
+    for (int z = z0; z < z1; z++)
+    {
+        for (int x = 0; x < iSize; x++)
+        {
+            size_t c = (size_t)z * iSize + x;
+            ErosionNeighbors(iSize, x, z, neighbors);
+            float a = fpHeights[c] + fpWater[c];
+            float d[4];
+            float fTotal = 0.0f, fSum = a;
+            int iLower = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                d[k] = 0.0f;
+                if (neighbors[k] < 0)
+                {
+                    continue;
+                }
+                float an = fpHeights[neighbors[k]] + fpWater[neighbors[k]];
+                if (an < a)
+                {
+                    d[k] = a - an;
+                    fTotal += d[k];
+                    fSum += an;
+                    iLower++;
+                }
+            }
+            float fMove = 0.0f;
+            if (iLower > 0 && fpWater[c] > 0.0f)
+            {
+                // 与较低格子的平均水面的差
+                float fAbove = a - fSum / (iLower + 1);
+                fMove = fpWater[c] < fAbove ? fpWater[c] : fAbove;
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                fpOut[c * 4 + k] = fMove > 0.0f ? fMove * d[k] / fTotal : 0.0f;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 收集流动：dst = src - 流出 + 流入
+// fpCarry 不为空时同时搬运 fpCarry（沉积物），搬运比例等于流出量占 fpSrc 的比例
+//----------------------------------------------------------------------
+static void GatherFlow(const float *fpSrc, const float *fpOut, float *fpDst, const float *fpCarry, float *fpCarryDst, int iSize, int z0, int z1)
+{
+    long long neighbors[4];
+    for (int z = z0; z < z1; z++)
+    {
+        for (int x = 0; x < iSize; x++)
+        {
+            size_t c = (size_t)z * iSize + x;
+            ErosionNeighbors(iSize, x, z, neighbors);
+            float fOut = fpOut[c * 4] + fpOut[c * 4 + 1] + fpOut[c * 4 + 2] + fpOut[c * 4 + 3];
+            float fIn = 0.0f;
+            float fCarryIn = 0.0f;
+            for (int k = 0; k < 4; k++)
+            {
+                if (neighbors[k] < 0)
+                {
+                    continue;
+                }
+                size_t n = (size_t)neighbors[k];
+                float fFlow = fpOut[n * 4 + EROSION_OPPOSITE[k]];
+                fIn += fFlow;
+                if (fpCarry != nullptr && fFlow > 0.0f)
+                {
+                    fCarryIn += fpCarry[n] * fFlow / fpSrc[n];
+                }
+            }
+            fpDst[c] = fpSrc[c] - fOut + fIn;
+            if (fpCarry != nullptr)
+            {
+                float fCarryOut = fOut > 0.0f ? fpCarry[c] * fOut / fpSrc[c] : 0.0f;
+                fpCarryDst[c] = fpCarry[c] - fCarryOut + fCarryIn;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// 对浮点高度执行热力与水力侵蚀，在 NormalizeTerrain 之前调用
+// 高度先归一化到 [0, 1]，侵蚀参数都相对于整张地图的高差
+//----------------------------------------------------------------------
+void CTERRAIN::ErodeTerrain(float *fpHeightData, int iThreads)
+{
+    const STRN_EROSION_SETTINGS &settings = m_erosion;
+    int iTotal = settings.iThermalIterations + settings.iHydraulicIterations;
+    if (iTotal <= 0)
+    {
+        return;
+    }
+    int iSize = m_iSize;
+    size_t count = (size_t)iSize * iSize;
+
+    float fMin = fpHeightData[0], fMax = fpHeightData[0];
+    for (size_t i = 1; i < count; i++)
+    {
+        fMin = fpHeightData[i] < fMin ? fpHeightData[i] : fMin;
+        fMax = fpHeightData[i] > fMax ? fpHeightData[i] : fMax;
+    }
+    if (fMax <= fMin)
+    {
+        return;
+    }
+    float fRange = fMax - fMin;
+    ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                  {
+        for (size_t i = (size_t)z0 * iSize; i < (size_t)z1 * iSize; i++)
+        {
+            fpHeightData[i] = (fpHeightData[i] - fMin) / fRange;
+        } });
+
+    std::vector<float> outflow(count * 4);
+    std::vector<float> scratch(count);
+    float *fpHeights = fpHeightData;
+    float *fpNext = scratch.data();
+    int iDone = 0;
+
+    // 热力侵蚀，休止角按每个格子的高差计
+    float fTalus = settings.fTalus / iSize;
+    for (int it = 0; it < settings.iThermalIterations; it++)
+    {
+        ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                      { ThermalOutflow(fpHeights, outflow.data(), iSize, z0, z1, fTalus, settings.fThermalRate); });
+        ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                      { GatherFlow(fpHeights, outflow.data(), fpNext, nullptr, nullptr, iSize, z0, z1); });
+        std::swap(fpHeights, fpNext);
+        if (m_pfnProgress)
+        {
+            m_pfnProgress((float)++iDone / iTotal, m_pProgressData);
+        }
+    }
+
+    // 水力侵蚀：降水、溶解、水流搬运沉积物、蒸发后析出超出携带能力的沉积物
+    if (settings.iHydraulicIterations > 0)
+    {
+        std::vector<float> water(count, 0.0f), waterNext(count);
+        std::vector<float> sediment(count, 0.0f), sedimentNext(count);
+        for (int it = 0; it < settings.iHydraulicIterations; it++)
+        {
+            uint64_t uiRainSeed = settings.uiSeed + (uint64_t)it * 0x9E3779B97F4A7C15ull;
+            ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                          {
+                for (int z = z0; z < z1; z++)
+                {
+                    for (int x = 0; x < iSize; x++)
+                    {
+                        size_t c = (size_t)z * iSize + x;
+                        // 降水量在 [0.5, 1.5) 倍之间随机变化
+                        water[c] += settings.fRain * (1.0f + 0.5f * RandomAt(uiRainSeed, x, z));
+                        float fDissolve = settings.fSolubility * water[c];
+                        fpHeights[c] -= fDissolve;
+                        sediment[c] += fDissolve;
+                    }
+                } });
+            ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                          { WaterOutflow(fpHeights, water.data(), outflow.data(), iSize, z0, z1); });
+            ParallelRange(iSize, iThreads, [&](int z0, int z1)
+                          {
+                GatherFlow(water.data(), outflow.data(), waterNext.data(), sediment.data(), sedimentNext.data(), iSize, z0, z1);
+                for (size_t c = (size_t)z0 * iSize; c < (size_t)z1 * iSize; c++)
+                {
+                    waterNext[c] *= 1.0f - settings.fEvaporation;
+                    float fCapacity = settings.fCapacity * waterNext[c];
+                    if (sedimentNext[c] > fCapacity)
+                    {
+                        fpHeights[c] += sedimentNext[c] - fCapacity;
+                        sedimentNext[c] = fCapacity;
+                    }
+                } });
+            water.swap(waterNext);
+            sediment.swap(sedimentNext);
+            if (m_pfnProgress)
+            {
+                m_pfnProgress((float)++iDone / iTotal, m_pProgressData);
+            }
+        }
+        // 剩余的沉积物全部析出
+        for (size_t c = 0; c < count; c++)
+        {
+            fpHeights[c] += sediment[c];
+        }
+    }
+
+    if (fpHeights != fpHeightData)
+    {
+        std::copy(fpHeights, fpHeights + count, fpHeightData);
+    }
+}
@@ -0,0 +1,294 @@
+#include "terrain.h"
+#include "simd.h"
+#include "terrain_util.h"
+#include <math.h>
+
+//----------------------------------------------------------------------
+// 菱形-正方形（中点位移）生成地形
+// 每一级先由正方形四角求中心（菱形步），再由菱形四角求边中点（正方形步）；
+// 同一步内的点只依赖上一步的结果，按行分给多个线程。每个点的随机位移由种子和坐标决定，结果与线程数无关
+//----------------------------------------------------------------------
+bool CTERRAIN::MakeTerrainDiamondSquare(int iSize, float fRoughness, uint64_t uiSeed, int iThreads)
+{
+    // iSize - 1 必须是 2 的幂
+    if (iSize < 3 || ((iSize - 1) & (iSize - 2)) != 0)
+    {
+        return false;
+    }
+    iThreads = ResolveThreadCount(iThreads);
+    if (!AllocHeightData(iSize))
+    {
+        return false;
+    }
+    size_t stride = (size_t)iSize;
+    std::vector<float> heights(stride * stride, 0.0f);
+    float *fpHeights = heights.data();
+
+    int n = iSize - 1;
+    fpHeights[0] = RandomAt(uiSeed, 0, 0);
+    fpHeights[n] = RandomAt(uiSeed, n, 0);
+    fpHeights[n * stride] = RandomAt(uiSeed, 0, n);
+    fpHeights[n * stride + n] = RandomAt(uiSeed, n, n);
+
+    float fScale = 1.0f;
+    float fDecay = powf(2.0f, -fRoughness);
+    for (int step = n; step > 1; step /= 2)
+    {
+        int half = step / 2;
+        int iCells = n / step;
+
+        // 菱形步：正方形中心 = 四角平均 + 随机位移
+        ParallelRange(iCells, iThreads, [&](int iBegin, int iEnd)
+                      {
+            for (int cz = iBegin; cz < iEnd; cz++)
+            {
+                int z = cz * step + half;
+                const float *fpUp = &fpHeights[(size_t)(z - half) * stride];
+                const float *fpDown = &fpHeights[(size_t)(z + half) * stride];
+                float *fpRow = &fpHeights[(size_t)z * stride];
+                for (int x = half; x < n; x += step)
+                {
+                    float fAverage = (fpUp[x - half] + fpUp[x + half] + fpDown[x - half] + fpDown[x + half]) * 0.25f;
+                    fpRow[x] = fAverage + RandomAt(uiSeed, x, z) * fScale;
+                }
+            } });
+
+        // 正方形步：边中点 = 上下左右（在边界上只有三个）的平均 + 随机位移
+        ParallelRange(n / half + 1, iThreads, [&](int iBegin, int iEnd)
+                      {
+            for (int rz = iBegin; rz < iEnd; rz++)
+            {
+                int z = rz * half;
+                float *fpRow = &fpHeights[(size_t)z * stride];
+                // 偶数行的边中点在正方形角点之间，奇数行在菱形中心之间
+                for (int x = (rz & 1) ? 0 : half; x <= n; x += step)
+                {
+                    float fSum = 0.0f;
+                    int iCount = 0;
+                    if (x >= half)
+                    {
+                        fSum += fpRow[x - half];
+                        iCount++;
+                    }
+                    if (x + half <= n)
+                    {
+                        fSum += fpRow[x + half];
+                        iCount++;
+                    }
+                    if (z >= half)
+                    {
+                        fSum += fpHeights[(size_t)(z - half) * stride + x];
+                        iCount++;
+                    }
+                    if (z + half <= n)
+                    {
+                        fSum += fpHeights[(size_t)(z + half) * stride + x];
+                        iCount++;
+                    }
+                    fpRow[x] = fSum / iCount + RandomAt(uiSeed, x, z) * fScale;
+                }
+            } });
+
+        fScale *= fDecay;
+    }
+
+    ErodeTerrain(fpHeights, iThreads);
+    NormalizeTerrain(fpHeights, iThreads);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// 梯度噪声：格点的梯度取四个对角方向之一，由格点坐标与种子的哈希决定
+//----------------------------------------------------------------------
+static inline uint32_t HashLattice(uint32_t ix, uint32_t iz, uint32_t uiSeed)
+{
+    uint32_t h = (ix * 0x8DA6B343u) ^ (iz * 0xD8163841u) ^ uiSeed;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+// 梯度与偏移向量的点积，梯度为 (±1, ±1)
+static inline float GradientDot(uint32_t h, float dx, float dz)
+{
+    return ((h & 1) ? -dx : dx) + ((h & 2) ? -dz : dz);
+}
+
+// 五次平滑曲线 6t^5 - 15t^4 + 10t^3
+static inline float Fade(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+//----------------------------------------------------------------------
+// 求 (fx, z) 处的噪声值，z 方向的格点 iz、偏移 dz 与权重 wz 由整行共用
+//----------------------------------------------------------------------
+static inline float GradientNoise(float fx, int iz, float dz, float wz, uint32_t uiSeed)
+{
+    float fx0 = floorf(fx);
+    int ix = (int)fx0;
+    float dx = fx - fx0;
+    float wx = Fade(dx);
+    float n00 = GradientDot(HashLattice((uint32_t)ix, (uint32_t)iz, uiSeed), dx, dz);
+    float n10 = GradientDot(HashLattice((uint32_t)ix + 1, (uint32_t)iz, uiSeed), dx - 1.0f, dz);
+    float n01 = GradientDot(HashLattice((uint32_t)ix, (uint32_t)iz + 1, uiSeed), dx, dz - 1.0f);
+    float n11 = GradientDot(HashLattice((uint32_t)ix + 1, (uint32_t)iz + 1, uiSeed), dx - 1.0f, dz - 1.0f);
+    float nx0 = n00 + wx * (n10 - n00);
+    float nx1 = n01 + wx * (n11 - n01);
+    return nx0 + wz * (nx1 - nx0);
+}
+
+//----------------------------------------------------------------------
+// 把一个八度的噪声累加到一行上：row[i] += amplitude * noise(i * fScale, fz)
+//----------------------------------------------------------------------
+static void AccumulateNoiseRowScalar(float *fpRow, int iCount, float fScale, float fz, float fAmplitude, uint32_t uiSeed)
+{
+    float fz0 = floorf(fz);
+    int iz = (int)fz0;
+    float dz = fz - fz0;
+    float wz = Fade(dz);
+    for (int i = 0; i < iCount; i++)
+    {
+        fpRow[i] += fAmplitude * GradientNoise((float)i * fScale, iz, dz, wz, uiSeed);
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 static inline __m256i HashLatticeAVX2(__m256i ix, __m256i iz, __m256i vSeed)
+{
+    __m256i h = _mm256_xor_si256(_mm256_xor_si256(_mm256_mullo_epi32(ix, _mm256_set1_epi32((int)0x8DA6B343u)), _mm256_mullo_epi32(iz, _mm256_set1_epi32((int)0xD8163841u))), vSeed);
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x2C1B3C6D));
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+}
+
+// 哈希的第 0、1 位移到符号位，与偏移向量异或即得到 ±dx ± dz
+SIMD_TARGET_AVX2 static inline __m256 GradientDotAVX2(__m256i h, __m256 dx, __m256 dz)
+{
+    __m256 sx = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+    __m256 sz = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31));
+    return _mm256_add_ps(_mm256_xor_ps(dx, sx), _mm256_xor_ps(dz, sz));
+}
+
+SIMD_TARGET_AVX2 static inline __m256 FadeAVX2(__m256 t)
+{
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+//----------------------------------------------------------------------
+// 一次计算 8 个相邻采样点，运算顺序与标量版本一致且不使用 FMA，结果逐位相同
+//----------------------------------------------------------------------
+SIMD_TARGET_AVX2 static void AccumulateNoiseRowAVX2(float *fpRow, int iCount, float fScale, float fz, float fAmplitude, uint32_t uiSeed)
+{
+    float fz0 = floorf(fz);
+    int iz = (int)fz0;
+    float dzScalar = fz - fz0;
+    __m256 dz = _mm256_set1_ps(dzScalar);
+    __m256 dz1 = _mm256_set1_ps(dzScalar - 1.0f);
+    __m256 wz = _mm256_set1_ps(Fade(dzScalar));
+    __m256i vz0 = _mm256_set1_epi32(iz);
+    __m256i vz1 = _mm256_set1_epi32(iz + 1);
+    __m256i vSeed = _mm256_set1_epi32((int)uiSeed);
+    __m256i vOne = _mm256_set1_epi32(1);
+    __m256 vOnef = _mm256_set1_ps(1.0f);
+    __m256 vScale = _mm256_set1_ps(fScale);
+    __m256 vAmplitude = _mm256_set1_ps(fAmplitude);
+    __m256i vIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= iCount; i += 8)
+    {
+        __m256 fx = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), vIndex)), vScale);
+        __m256 fx0 = _mm256_floor_ps(fx);
+        __m256i ix = _mm256_cvttps_epi32(fx0);
+        __m256i ix1 = _mm256_add_epi32(ix, vOne);
+        __m256 dx = _mm256_sub_ps(fx, fx0);
+        __m256 dx1 = _mm256_sub_ps(dx, vOnef);
+        __m256 wx = FadeAVX2(dx);
+
+        __m256 n00 = GradientDotAVX2(HashLatticeAVX2(ix, vz0, vSeed), dx, dz);
+        __m256 n10 = GradientDotAVX2(HashLatticeAVX2(ix1, vz0, vSeed), dx1, dz);
+        __m256 n01 = GradientDotAVX2(HashLatticeAVX2(ix, vz1, vSeed), dx, dz1);
+        __m256 n11 = GradientDotAVX2(HashLatticeAVX2(ix1, vz1, vSeed), dx1, dz1);
+        __m256 nx0 = _mm256_add_ps(n00, _mm256_mul_ps(wx, _mm256_sub_ps(n10, n00)));
+        __m256 nx1 = _mm256_add_ps(n01, _mm256_mul_ps(wx, _mm256_sub_ps(n11, n01)));
+        __m256 value = _mm256_add_ps(nx0, _mm256_mul_ps(wz, _mm256_sub_ps(nx1, nx0)));
+        _mm256_storeu_ps(&fpRow[i], _mm256_add_ps(_mm256_loadu_ps(&fpRow[i]), _mm256_mul_ps(vAmplitude, value)));
+    }
+    // 剩余不足 8 个的点用标量计算
+    float wzScalar = Fade(dzScalar);
+    for (; i < iCount; i++)
+    {
+        fpRow[i] += fAmplitude * GradientNoise((float)i * fScale, iz, dzScalar, wzScalar, uiSeed);
+    }
+}
+#endif
+
+//----------------------------------------------------------------------
+// 生成常用的 fBm 八度参数：每个八度频率乘 fLacunarity，振幅乘 fGain
+// fBaseFrequency: 第一个八度在整张地图上的周期数
+//----------------------------------------------------------------------
+std::vector<STRN_NOISE_OCTAVE> CTERRAIN::MakeNoiseOctaves(int iOctaves, float fBaseFrequency, float fLacunarity, float fGain)
+{
+    std::vector<STRN_NOISE_OCTAVE> octaves(iOctaves > 0 ? iOctaves : 0);
+    float fFrequency = fBaseFrequency;
+    float fAmplitude = 1.0f;
+    for (size_t i = 0; i < octaves.size(); i++)
+    {
+        octaves[i].fFrequency = fFrequency;
+        octaves[i].fAmplitude = fAmplitude;
+        fFrequency *= fLacunarity;
+        fAmplitude *= fGain;
+    }
+    return octaves;
+}
+
+//----------------------------------------------------------------------
+// 用分形布朗运动（多个八度的梯度噪声叠加）生成地形
+// octaves: 每个八度的频率（整张地图上的周期数）与振幅
+// 按行分给多个线程，每个格子按八度的顺序累加，结果与线程数无关
+//----------------------------------------------------------------------
+bool CTERRAIN::MakeTerrainNoise(int iSize, const std::vector<STRN_NOISE_OCTAVE> &octaves, uint64_t uiSeed, int iThreads)
+{
+    if (iSize < 2)
+    {
+        return false;
+    }
+    iThreads = ResolveThreadCount(iThreads);
+    if (!AllocHeightData(iSize))
+    {
+        return false;
+    }
+    size_t stride = (size_t)iSize;
+    std::vector<float> heights(stride * stride, 0.0f);
+    float *fpHeights = heights.data();
+
+    void (*accumulateRow)(float *, int, float, float, float, uint32_t) = AccumulateNoiseRowScalar;
+#ifdef SIMD_X86
+    if (GetSimdLevel() == SIMD_AVX2)
+    {
+        accumulateRow = AccumulateNoiseRowAVX2;
+    }
+#endif
+
+    ParallelRange(iSize, iThreads, [&](int iBegin, int iEnd)
+                  {
+        for (int z = iBegin; z < iEnd; z++)
+        {
+            float *fpRow = &fpHeights[(size_t)z * stride];
+            for (size_t o = 0; o < octaves.size(); o++)
+            {
+                // 每个八度使用不同的哈希种子，避免各八度的格点对齐
+                uint64_t uiState = uiSeed + o;
+                uint32_t uiOctaveSeed = (uint32_t)SplitMix64(uiState);
+                float fScale = octaves[o].fFrequency / (float)(iSize - 1);
+                accumulateRow(fpRow, iSize, fScale, (float)z * fScale, octaves[o].fAmplitude, uiOctaveSeed);
+            }
+        } });
+
+    ErodeTerrain(fpHeights, iThreads);
+    NormalizeTerrain(fpHeights, iThreads);
+    return true;
+}
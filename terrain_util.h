@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+
+//----------------------------------------------------------------------
+// 地形生成各部分共用的工具：并行循环与基于种子的随机数
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+// 把 [0, iCount) 分成 iThreads 段，交给任务调度器并行执行 func(iBegin, iEnd)，返回时全部完成
+// 分段只由 iThreads 决定，与实际执行的线程无关
+//----------------------------------------------------------------------
+template <typename F>
+inline void ParallelRange(int iCount, int iThreads, const F &func)
+{
+    if (iThreads > iCount)
+    {
+        iThreads = iCount;
+    }
+    if (iThreads <= 1)
+    {
+        func(0, iCount);
+        return;
+    }
+    JobSystem::instance().parallelFor(iThreads, 1, [&](int iBegin, int iEnd)
+                                      {
+        for (int t = iBegin; t < iEnd; t++)
+        {
+            func(iCount * t / iThreads, iCount * (t + 1) / iThreads);
+        } });
+}
+
+// iThreads <= 0 时使用调度器的全部线程
+inline int ResolveThreadCount(int iThreads)
+{
+    if (iThreads <= 0)
+    {
+        iThreads = JobSystem::instance().getConcurrency();
+    }
+    return iThreads > 0 ? iThreads : 1;
+}
+
+//----------------------------------------------------------------------
+// 由 64 位种子生成伪随机数（splitmix64），各平台结果一致
+//----------------------------------------------------------------------
+inline uint64_t SplitMix64(uint64_t &uiState)
+{
+    uint64_t z = (uiState += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// 返回 [0, n) 内的随机整数
+inline int RandomBelow(uint64_t &uiState, int n)
+{
+    return (int)(((SplitMix64(uiState) >> 32) * (uint64_t)n) >> 32);
+}
+
+//----------------------------------------------------------------------
+// 由种子和格点坐标直接得到 [-1, 1) 内的随机数，与计算顺序、线程划分无关
+//----------------------------------------------------------------------
+inline float RandomAt(uint64_t uiSeed, int x, int z)
+{
+    uint64_t uiState = uiSeed ^ (((uint64_t)(uint32_t)z << 32) | (uint32_t)x);
+    return (float)(SplitMix64(uiState) >> 40) * (2.0f / 16777216.0f) - 1.0f;
+}
@@ -0,0 +1,148 @@
+#include "uploadthread.h"
+#include <iostream>
+
+UploadThread::UploadThread()
+    : window(nullptr), iPending(0), bQuit(false)
+{
+}
+
+UploadThread::~UploadThread()
+{
+    stop();
+}
+
+bool UploadThread::start(GLFWwindow *shareWindow)
+{
+    if (window != nullptr)
+    {
+        return true;
+    }
+    // 隐藏窗口沿用主窗口的上下文版本，只是不显示
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(1, 1, "Upload", nullptr, shareWindow);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (window == nullptr)
+    {
+        std::cerr << "Failed to create upload context, uploading on the render thread" << std::endl;
+        return false;
+    }
+    bQuit = false;
+    thread = std::thread(&UploadThread::threadLoop, this);
+    return true;
+}
+
+void UploadThread::stop()
+{
+    if (window == nullptr)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bQuit = true;
+    }
+    condition.notify_one();
+    thread.join();
+
+    // 主上下文是当前上下文，栅栏是共享对象，可以在这里删除
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        glDeleteSync(requests[i].ready);
+    }
+    for (size_t i = 0; i < completed.size(); i++)
+    {
+        glDeleteSync(completed[i].done);
+    }
+    requests.clear();
+    completed.clear();
+    iPending = 0;
+    glfwDestroyWindow(window);
+    window = nullptr;
+}
+
+void UploadThread::submit(std::function<void()> upload, std::function<void()> onComplete)
+{
+    Request request;
+    request.upload = std::move(upload);
+    request.onComplete = std::move(onComplete);
+    request.ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    request.done = nullptr;
+    // 栅栏必须提交给驱动，另一个上下文才能等到它
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(std::move(request));
+        iPending++;
+    }
+    condition.notify_one();
+}
+
+int UploadThread::poll()
+{
+    int iCount = 0;
+    for (;;)
+    {
+        Request request;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (completed.empty())
+            {
+                break;
+            }
+            // 只检查队首，完成回调保持提交顺序
+            GLenum eResult = glClientWaitSync(completed.front().done, 0, 0);
+            if (eResult != GL_ALREADY_SIGNALED && eResult != GL_CONDITION_SATISFIED)
+            {
+                break;
+            }
+            request = std::move(completed.front());
+            completed.pop_front();
+            iPending--;
+        }
+        glDeleteSync(request.done);
+        if (request.onComplete)
+        {
+            request.onComplete();
+        }
+        iCount++;
+    }
+    return iCount;
+}
+
+int UploadThread::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return iPending;
+}
+
+void UploadThread::threadLoop()
+{
+    glfwMakeContextCurrent(window);
+    for (;;)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]
+                           { return bQuit || !requests.empty(); });
+            if (bQuit)
+            {
+                break;
+            }
+            request = std::move(requests.front());
+            requests.pop_front();
+        }
+        // 等待主上下文中提交前的命令执行完，例如缓冲区的分配
+        glWaitSync(request.ready, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(request.ready);
+        request.upload();
+        request.done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.push_back(std::move(request));
+        }
+    }
+    glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//----------------------------------------------------------------------
+// 后台 GL 上传线程
+// 线程持有一个隐藏窗口的上下文，与主窗口共享缓冲区、纹理等对象（VAO 不共享，需要在主线程创建）。
+// 交接用栅栏同步：提交时在主上下文插入栅栏，上传线程等待它后再执行，保证主线程此前创建的对象已经可用；
+// 上传完成后在上传上下文插入栅栏，主线程在 poll 中发现栅栏已触发时才执行完成回调，之后可以安全地绘制
+//----------------------------------------------------------------------
+class UploadThread
+{
+public:
+    UploadThread();
+    ~UploadThread();
+
+    //----------------------------------------------------------------------
+    // 创建与 shareWindow 共享对象的隐藏窗口并启动线程，必须在主线程调用
+    // 创建失败时返回 false，调用者应在主线程上直接上传
+    //----------------------------------------------------------------------
+    bool start(GLFWwindow *shareWindow);
+
+    // 停止线程并销毁隐藏窗口，未执行的请求被丢弃，必须在主线程调用
+    void stop();
+
+    bool isRunning() const { return window != nullptr; }
+
+    //----------------------------------------------------------------------
+    // 提交上传请求，在主线程调用
+    // upload: 在上传线程的上下文中执行
+    // onComplete: 上传结果对主上下文可见后，在主线程的 poll 中执行
+    // 完成回调按提交顺序执行
+    //----------------------------------------------------------------------
+    void submit(std::function<void()> upload, std::function<void()> onComplete);
+
+    // 在主线程每帧调用，执行已完成请求的回调，返回执行的个数
+    int poll();
+
+    // 还没有执行完成回调的请求数
+    int getPendingCount() const;
+
+private:
+    UploadThread(const UploadThread &);
+    UploadThread &operator=(const UploadThread &);
+
+    struct Request
+    {
+        std::function<void()> upload;
+        std::function<void()> onComplete;
+        GLsync ready; // 主上下文中提交时插入的栅栏
+        GLsync done;  // 上传上下文中上传后插入的栅栏
+    };
+
+    void threadLoop();
+
+    GLFWwindow *window;
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Request> requests;  // 等待上传
+    std::deque<Request> completed; // 已上传，等待栅栏触发
+    int iPending;
+    bool bQuit;
+};